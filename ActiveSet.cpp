@@ -0,0 +1,247 @@
+#include "ActiveSet.h"
+
+#include <algorithm>
+#include <numeric>
+
+ActiveSet::ActiveSet(Arena& arena, const size_t capacity, const size_t numLiveIn, const size_t chunkSizeIn, const bool canWakeIn)
+    : chunkSize(chunkSizeIn), numLive(numLiveIn), numActive(numLiveIn), simulatedEnd(numLiveIn), previousSimulatedEnd(numLiveIn), canWake(canWakeIn)
+{
+    // Slots past the live entities hold the free ids, so every id always has a slot and ids only ever move by swapping.
+    entityIds = Entity::AllocateStream<uint32_t>(arena, capacity);
+    std::iota(entityIds.begin(), entityIds.end(), 0);
+    entitySlots = Entity::AllocateStream<uint32_t>(arena, capacity);
+    std::iota(entitySlots.begin(), entitySlots.end(), 0);
+    swaps = Entity::AllocateStream<std::pair<uint32_t, uint32_t>>(arena, 3 * capacity);
+    isChunkTouched = Entity::AllocateStream<uint8_t>(arena, (capacity + chunkSize - 1) / chunkSize);
+    std::fill(isChunkTouched.begin(), isChunkTouched.end(), 0);
+}
+
+size_t ActiveSet::GetArenaBytes(const size_t capacity, const size_t chunkSize)
+{
+    return 2 * Entity::GetStreamBytes<uint32_t>(capacity) + Entity::GetStreamBytes<std::pair<uint32_t, uint32_t>>(3 * capacity) + Entity::GetStreamBytes<uint8_t>((capacity + chunkSize - 1) / chunkSize);
+}
+
+size_t ActiveSet::GetCapacity() const
+{
+    return entityIds.size();
+}
+
+size_t ActiveSet::GetNumLive() const
+{
+    return numLive;
+}
+
+size_t ActiveSet::GetNumActive() const
+{
+    return numActive;
+}
+
+size_t ActiveSet::GetSimulatedEnd() const
+{
+    return simulatedEnd;
+}
+
+size_t ActiveSet::GetLastSimulatedEnd() const
+{
+    return previousSimulatedEnd;
+}
+
+std::span<const uint32_t> ActiveSet::GetEntityIds() const
+{
+    return entityIds.first(numLive);
+}
+
+std::span<const uint32_t> ActiveSet::GetAllEntityIds() const
+{
+    return entityIds;
+}
+
+uint32_t ActiveSet::GetSlot(const uint32_t entityId) const
+{
+    return entitySlots[entityId];
+}
+
+void ActiveSet::Compact(Entity::Positions& positions, SpatialBins& bins, Entity::Velocities& velocities, Entity::Physics& physics)
+{
+    numSwaps = 0;
+    std::fill(isChunkTouched.begin(), isChunkTouched.end(), 0);
+
+    // The last active entity takes the place of every one that came to rest, and is looked at again in its new slot.
+    for (size_t slot = 0; slot < numActive;)
+    {
+        if (IsResting(velocities, physics, slot))
+        {
+            numActive--;
+            Swap(positions, velocities, physics, static_cast<uint32_t>(slot), static_cast<uint32_t>(numActive));
+        }
+        else
+        {
+            slot++;
+        }
+    }
+
+    // Entities can only start moving again by being pushed, the first resting entity takes the place of every one that was.
+    if (canWake)
+    {
+        for (size_t slot = numActive; slot < numLive; slot++)
+        {
+            if (velocities.speed[slot] > 0.0f)
+            {
+                Swap(positions, velocities, physics, static_cast<uint32_t>(slot), static_cast<uint32_t>(numActive));
+                numActive++;
+            }
+        }
+    }
+
+    previousSimulatedEnd = simulatedEnd;
+    if (numSwaps == 0)
+    {
+        return;
+    }
+
+    UpdateSimulatedEnd();
+    BinTouchedChunks(positions, bins);
+}
+
+void ActiveSet::Publish(const PositionFrame& compacted, const std::span<PositionFrame> frames)
+{
+    for (size_t i = 0; i < numSwaps; i++)
+    {
+        SwapIds(swaps[i].first, swaps[i].second);
+    }
+
+    SyncFrames(compacted, frames);
+}
+
+void ActiveSet::BeginChanges()
+{
+    isChanging = true;
+    numSwaps = 0;
+    std::fill(isChunkTouched.begin(), isChunkTouched.end(), 0);
+    previousSimulatedEnd = simulatedEnd;
+}
+
+void ActiveSet::Despawn(const uint32_t entityId, PositionFrame& frame, Entity::Velocities& velocities, Entity::Physics& physics)
+{
+    // An active entity first trades places with the last active one, then the last live entity fills the hole.
+    uint32_t slot = entitySlots[entityId];
+    if (slot < numActive)
+    {
+        numActive--;
+        Swap(frame.positions, velocities, physics, slot, static_cast<uint32_t>(numActive));
+        slot = static_cast<uint32_t>(numActive);
+    }
+
+    numLive--;
+    Swap(frame.positions, velocities, physics, slot, static_cast<uint32_t>(numLive));
+}
+
+void ActiveSet::Spawn(const uint32_t entityId, const Entity::State& state, PositionFrame& frame, Entity::Velocities& velocities, Entity::Physics& physics)
+{
+    // New entities are moving, the first resting entity makes room by moving to the end of the live ones.
+    // Nothing in a free slot matters but its id, so the id being spawned is swapped in without the rest.
+    const uint32_t slot = static_cast<uint32_t>(numActive);
+    Swap(frame.positions, velocities, physics, slot, static_cast<uint32_t>(numLive));
+    SwapIds(slot, entitySlots[entityId]);
+    numLive++;
+    numActive++;
+
+    frame.positions.x[slot] = state.x;
+    frame.positions.y[slot] = state.y;
+    velocities.speed[slot] = state.speed;
+    velocities.directionX[slot] = state.directionX;
+    velocities.directionY[slot] = state.directionY;
+    physics.acceleration[slot] = state.acceleration;
+}
+
+void ActiveSet::EndChanges(PositionFrame& frame, const std::span<PositionFrame> frames)
+{
+    isChanging = false;
+    if (numSwaps == 0)
+    {
+        return;
+    }
+
+    UpdateSimulatedEnd();
+    BinTouchedChunks(frame.positions, frame.bins);
+    SyncFrames(frame, frames);
+}
+
+bool ActiveSet::IsResting(const Entity::Velocities& velocities, const Entity::Physics& physics, const size_t slot) const
+{
+    return velocities.speed[slot] == 0.0f && physics.acceleration[slot] <= 0.0f;
+}
+
+void ActiveSet::Swap(Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, const uint32_t first, const uint32_t second)
+{
+    // Swapping a slot with itself changes nothing here, but it is still recorded so the entity is copied into the other frames.
+    swaps[numSwaps++] = { first, second };
+    isChunkTouched[first / chunkSize] = 1;
+    isChunkTouched[second / chunkSize] = 1;
+
+    std::swap(positions.x[first], positions.x[second]);
+    std::swap(positions.y[first], positions.y[second]);
+    std::swap(velocities.speed[first], velocities.speed[second]);
+    std::swap(velocities.directionX[first], velocities.directionX[second]);
+    std::swap(velocities.directionY[first], velocities.directionY[second]);
+    std::swap(physics.acceleration[first], physics.acceleration[second]);
+
+    if (isChanging)
+    {
+        SwapIds(first, second);
+    }
+}
+
+void ActiveSet::SwapIds(const uint32_t first, const uint32_t second)
+{
+    std::swap(entityIds[first], entityIds[second]);
+    entitySlots[entityIds[first]] = first;
+    entitySlots[entityIds[second]] = second;
+}
+
+void ActiveSet::BinTouchedChunks(const Entity::Positions& positions, SpatialBins& bins) const
+{
+    for (size_t begin = 0; begin < numLive; begin += chunkSize)
+    {
+        if (isChunkTouched[begin / chunkSize] != 0)
+        {
+            bins.BinRange(positions, begin, std::min(begin + chunkSize, numLive));
+        }
+    }
+}
+
+void ActiveSet::SyncFrames(const PositionFrame& compacted, const std::span<PositionFrame> frames) const
+{
+    if (numSwaps == 0)
+    {
+        return;
+    }
+
+    for (PositionFrame& frame : frames)
+    {
+        if (frame.positions.x.data() == compacted.positions.x.data())
+        {
+            continue;
+        }
+
+        ForEachSwappedSlot([&frame, &compacted](const uint32_t slot)
+        {
+            frame.positions.x[slot] = compacted.positions.x[slot];
+            frame.positions.y[slot] = compacted.positions.y[slot];
+        });
+
+        // Chunks the simulation no longer writes are binned here one last time, and binned again whenever an entity in them is swapped.
+        for (size_t begin = simulatedEnd / chunkSize * chunkSize; begin < numLive; begin += chunkSize)
+        {
+            if (isChunkTouched[begin / chunkSize] != 0 || begin < previousSimulatedEnd)
+            {
+                frame.bins.BinRange(frame.positions, begin, std::min(begin + chunkSize, numLive));
+            }
+        }
+    }
+}
+
+void ActiveSet::UpdateSimulatedEnd()
+{
+    simulatedEnd = std::min((numActive + chunkSize - 1) / chunkSize * chunkSize, numLive);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+#include "Arena.h"
+#include "Entity.h"
+#include "PositionFrame.h"
+
+// Where every entity is stored. Live entities are packed at the front of the streams, with the ones that are still moving in front of the ones that have come to rest,
+// so the simulation only has to walk a prefix of the streams and no job ever sees a hole.
+// Gravity only ever pulls acceleration down and speed is clamped at zero, so an entity that has stopped never moves again on its own. Only a collision can set it moving again.
+// Entities change places by swapping slots. Every stream indexed by slot has to make the same swaps in the same order, GetEntityIds maps slots back to entities.
+// Entity ids stay the same for as long as the entity lives, EntityHandles hands them out.
+class ActiveSet
+{
+public:
+    // Chunks are the simulation's grain size, which is also the chunk size of the frames' bins. Entities can only be woken up again when canWake is set.
+    // Entities [0, numLive) are live to begin with, with the same ids as their slots.
+    ActiveSet(Arena& arena, size_t capacity, size_t numLive, size_t chunkSize, bool canWake);
+
+    static size_t GetArenaBytes(size_t capacity, size_t chunkSize);
+
+    size_t GetCapacity() const;
+    size_t GetNumLive() const;
+    size_t GetNumActive() const;
+
+    // Every chunk holding an active entity. Resting entities that share a chunk with active ones are simulated along with them, their positions don't change.
+    size_t GetSimulatedEnd() const;
+
+    // The simulated end the last Compact started from. Every entity the simulation moved is in a slot in front of it, or in one of the swapped slots.
+    size_t GetLastSimulatedEnd() const;
+
+    // The entity in every live slot, and the slot of every live entity, as of the last Publish or EndChanges.
+    std::span<const uint32_t> GetEntityIds() const;
+    std::span<const uint32_t> GetAllEntityIds() const; // Followed by the free ids, in the slots past the live entities.
+    uint32_t GetSlot(uint32_t entityId) const;
+
+    // Simulation side, once every entity has moved: swaps the entities that came to rest behind the moving ones, and the ones set moving again in front of them.
+    // The swaps are made in positions, velocities and physics, and the chunks they touched are binned again. Runs on the calling thread, it only touches the entities that changed.
+    void Compact(Entity::Positions& positions, SpatialBins& bins, Entity::Velocities& velocities, Entity::Physics& physics);
+
+    // Every slot that took part in a swap of the last Compact or batch of changes, some of them more than once.
+    template<typename Function>
+    void ForEachSwappedSlot(const Function& function) const;
+
+    // Once nothing reads the previous frame any more: makes the swaps of the last Compact in the entity ids, and copies the swapped entities from compacted into every other frame.
+    // Slots past the simulated end are never written by the simulation, this keeps them right in whichever frame it writes next.
+    void Publish(const PositionFrame& compacted, std::span<PositionFrame> frames);
+
+    // Between frames, while no job runs: removes and adds entities by swapping them across the ends of the active and live entities.
+    // The streams given are the whole storage, not just the live entities, and frame is the last published one.
+    void BeginChanges();
+    void Despawn(uint32_t entityId, PositionFrame& frame, Entity::Velocities& velocities, Entity::Physics& physics);
+    void Spawn(uint32_t entityId, const Entity::State& state, PositionFrame& frame, Entity::Velocities& velocities, Entity::Physics& physics);
+    void EndChanges(PositionFrame& frame, std::span<PositionFrame> frames);
+
+private:
+    bool IsResting(const Entity::Velocities& velocities, const Entity::Physics& physics, size_t slot) const;
+    void Swap(Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, uint32_t first, uint32_t second);
+    void SwapIds(uint32_t first, uint32_t second);
+    void BinTouchedChunks(const Entity::Positions& positions, SpatialBins& bins) const;
+    void SyncFrames(const PositionFrame& compacted, std::span<PositionFrame> frames) const;
+    void UpdateSimulatedEnd();
+
+    size_t chunkSize;
+    size_t numLive;
+    size_t numActive;
+    size_t simulatedEnd;
+    size_t previousSimulatedEnd;
+    bool canWake;
+    bool isChanging = false; // Between frames ids are swapped right away, during them it waits for Publish.
+
+    std::span<uint32_t> entityIds;
+    std::span<uint32_t> entitySlots;
+
+    // A despawn swaps twice and a spawn once. A batch can't despawn more entities than there are ids, or spawn more than there are free ones.
+    std::span<std::pair<uint32_t, uint32_t>> swaps;
+    size_t numSwaps = 0;
+    std::span<uint8_t> isChunkTouched;
+};
+
+template<typename Function>
+void ActiveSet::ForEachSwappedSlot(const Function& function) const
+{
+    for (size_t i = 0; i < numSwaps; i++)
+    {
+        function(swaps[i].first);
+        function(swaps[i].second);
+    }
+}
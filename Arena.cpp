@@ -0,0 +1,76 @@
+#include "Arena.h"
+
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+
+constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+Arena::Arena(const size_t capacityIn, const bool useHugePages)
+{
+    capacity = (capacityIn + hugePageSize - 1) / hugePageSize * hugePageSize;
+
+    void* mapped = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    // Explicit huge pages only work if the system has a pool of them set aside, otherwise fall back to regular pages below.
+    // They are reserved from the pool up front, without that the first touch of a page the pool can't back is a SIGBUS instead of a failed mmap.
+    if (useHugePages)
+    {
+        mapped = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        isUsingHugePages = mapped != MAP_FAILED;
+    }
+#endif
+
+    if (mapped == MAP_FAILED)
+    {
+        mapped = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mapped == MAP_FAILED)
+        {
+            throw std::bad_alloc();
+        }
+
+#ifdef MADV_HUGEPAGE
+        // Ask for transparent huge pages instead, this is only a hint and it's fine if the kernel ignores it.
+        if (useHugePages)
+        {
+            isUsingHugePages = madvise(mapped, capacity, MADV_HUGEPAGE) == 0;
+        }
+#endif
+    }
+
+    memory = static_cast<std::byte*>(mapped);
+}
+
+Arena::~Arena()
+{
+    munmap(memory, capacity);
+}
+
+void* Arena::Allocate(const size_t size, const size_t alignment)
+{
+    const size_t begin = (used + alignment - 1) / alignment * alignment;
+    if (begin + size > capacity)
+    {
+        std::cerr << "The arena is out of room, " << size << " more bytes asked for with " << used << " of " << capacity << " used." << std::endl;
+        throw std::bad_alloc();
+    }
+
+    used = begin + size;
+    return memory + begin;
+}
+
+size_t Arena::GetCapacity() const
+{
+    return capacity;
+}
+
+size_t Arena::GetUsed() const
+{
+    return used;
+}
+
+bool Arena::IsUsingHugePages() const
+{
+    return isUsingHugePages;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+// A single block of memory that everything sized by the entity count is carved out of. Nothing is ever freed on its own, the whole block goes away with the arena.
+// The capacity is only reserved up front, pages are backed by physical memory when they are first touched.
+class Arena
+{
+public:
+    Arena(size_t capacity, bool useHugePages);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment);
+
+    template<typename T>
+    std::span<T> Allocate(const size_t count, const size_t alignment = alignof(T))
+    {
+        return std::span<T>(static_cast<T*>(Allocate(count * sizeof(T), alignment)), count);
+    }
+
+    size_t GetCapacity() const;
+    size_t GetUsed() const;
+    bool IsUsingHugePages() const;
+
+private:
+    std::byte* memory = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    bool isUsingHugePages = false;
+};
@@ -0,0 +1,283 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <ncurses.h>
+
+#include "Arena.h"
+#include "JobSystem.h"
+#include "Entity.h"
+#include "RandomizeJob.h"
+#include "SimulateMotionJob.h"
+#include "RenderJob.h"
+#include "SpatialBins.h"
+#include "SpatialGrid.h"
+
+namespace Benchmark
+{
+    struct Result
+    {
+        std::string kernel;
+        size_t numItems;
+        size_t bytesPerItem;
+        double meanNs;
+        double minNs;
+        double varianceNs;
+    };
+
+    struct Settings
+    {
+        std::vector<size_t> entityCounts{ 1000, 10000, 100000, 250000, 1000000 };
+        size_t repetitions = 20;
+        std::string jsonPath;
+        std::string csvPath;
+    };
+
+    // Runs the kernel once to warm up caches and page in memory, then times every repetition on its own.
+    template<typename Function>
+    Result Measure(const std::string& kernel, const size_t numItems, const size_t bytesPerItem, const size_t repetitions, const Function& function)
+    {
+        function();
+
+        std::vector<double> samples;
+        samples.reserve(repetitions);
+        for (size_t i = 0; i < repetitions; i++)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            function();
+            const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        }
+
+        double sum = 0.0;
+        for (const double sample : samples)
+        {
+            sum += sample;
+        }
+
+        const double mean = sum / static_cast<double>(samples.size());
+        double squaredDeviations = 0.0;
+        for (const double sample : samples)
+        {
+            squaredDeviations += (sample - mean) * (sample - mean);
+        }
+
+        return Result{ kernel, numItems, bytesPerItem, mean, *std::min_element(samples.begin(), samples.end()), squaredDeviations / static_cast<double>(samples.size()) };
+    }
+
+    double GetNsPerItem(const Result& result)
+    {
+        return result.meanNs / static_cast<double>(result.numItems);
+    }
+
+    double GetGigabytesPerSecond(const Result& result)
+    {
+        // Bytes per nanosecond is the same thing as gigabytes per second.
+        return static_cast<double>(result.numItems * result.bytesPerItem) / result.meanNs;
+    }
+
+    void PrintTable(const std::vector<Result>& results)
+    {
+        std::cout << std::left << std::setw(28) << "Kernel" << std::right << std::setw(10) << "Items" << std::setw(14) << "Mean (us)" << std::setw(14) << "Stddev (us)" << std::setw(12) << "ns/item" << std::setw(10) << "GB/s" << std::endl;
+        for (const Result& result : results)
+        {
+            std::cout << std::left << std::setw(28) << result.kernel << std::right << std::setw(10) << result.numItems
+                << std::fixed << std::setprecision(2) << std::setw(14) << result.meanNs / 1000.0 << std::setw(14) << std::sqrt(result.varianceNs) / 1000.0
+                << std::setprecision(3) << std::setw(12) << GetNsPerItem(result) << std::setprecision(2) << std::setw(10) << GetGigabytesPerSecond(result) << std::endl;
+        }
+    }
+
+    void WriteJson(const std::vector<Result>& results, const std::string& path)
+    {
+        std::ofstream file(path);
+        file << "{\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Result& result = results[i];
+            file << "    { \"kernel\": \"" << result.kernel << "\", \"items\": " << result.numItems << ", \"meanNs\": " << result.meanNs << ", \"minNs\": " << result.minNs
+                << ", \"varianceNs2\": " << result.varianceNs << ", \"nsPerItem\": " << GetNsPerItem(result) << ", \"gbPerSecond\": " << GetGigabytesPerSecond(result) << " }"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        file << "  ]\n}\n";
+    }
+
+    void WriteCsv(const std::vector<Result>& results, const std::string& path)
+    {
+        std::ofstream file(path);
+        file << "kernel,items,meanNs,minNs,varianceNs2,nsPerItem,gbPerSecond\n";
+        for (const Result& result : results)
+        {
+            file << result.kernel << ',' << result.numItems << ',' << result.meanNs << ',' << result.minNs << ',' << result.varianceNs << ',' << GetNsPerItem(result) << ',' << GetGigabytesPerSecond(result) << '\n';
+        }
+    }
+
+    bool ParseArguments(const int argc, char** argv, Settings& outSettings)
+    {
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            const std::string key = argv[i];
+            const std::string value = argv[i + 1];
+            if (key == "--entities")
+            {
+                outSettings.entityCounts.clear();
+                std::stringstream stream(value);
+                std::string count;
+                while (std::getline(stream, count, ','))
+                {
+                    outSettings.entityCounts.push_back(std::stoull(count));
+                }
+            }
+            else if (key == "--repetitions")
+            {
+                outSettings.repetitions = std::max<size_t>(std::stoull(value), 1);
+            }
+            else if (key == "--json")
+            {
+                outSettings.jsonPath = value;
+            }
+            else if (key == "--csv")
+            {
+                outSettings.csvPath = value;
+            }
+            else
+            {
+                std::cerr << "Unknown option: " << key << std::endl;
+                return false;
+            }
+        }
+
+        return argc % 2 == 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Benchmark::Settings settings;
+    if (!Benchmark::ParseArguments(argc, argv, settings))
+    {
+        std::cerr << "Usage: " << argv[0] << " [--entities 1000,10000,...] [--repetitions 20] [--json results.json] [--csv results.csv]" << std::endl;
+        return 1;
+    }
+
+    // Only the version the CPU picks is measured below, make sure every version is right first.
+    if (!RandomizeJob::CheckKnownAnswers())
+    {
+        return 1;
+    }
+
+    // Send everything ncurses and the ANSI backend draw to /dev/null, SwapBuffers still does all of its work but the results stay readable.
+    FILE* devNull = std::fopen("/dev/null", "w+");
+    SCREEN* screen = newterm(std::getenv("TERM") != nullptr ? nullptr : "xterm", devNull, devNull);
+    if (screen == nullptr)
+    {
+        std::cerr << "Could not set up a terminal for the render benchmarks." << std::endl;
+        return 1;
+    }
+
+    // Same workers as the app, so every kernel that splits its work across the job system is measured the way the app runs it.
+    JobSystem::Initialize();
+
+    constexpr float deltaTime = 1.0f / 60.0f;
+    std::vector<Benchmark::Result> results;
+
+    for (const size_t numEntities : settings.entityCounts)
+    {
+        // The same world the app keeps, and the bins, grid and draw properties measured below.
+        const size_t arenaBytes = Entity::GetWorldBytes(numEntities) + RenderJob::GetVisibilityBinsArenaBytes(numEntities, SimulateMotionJob::GetGrainSize())
+            + SpatialGrid::GetArenaBytes(numEntities) + Entity::GetStreamBytes<DrawProperties>(numEntities);
+        Arena arena(arenaBytes, false);
+        const Entity::Positions previousPositions = Entity::AllocatePositions(arena, numEntities);
+        Entity::Positions positions = Entity::AllocatePositions(arena, numEntities);
+        Entity::Velocities velocities = Entity::AllocateVelocities(arena, numEntities);
+        Entity::Physics physics = Entity::AllocatePhysics(arena, numEntities);
+
+        Entity::Positions randomizedPositions = previousPositions;
+        constexpr uint64_t seed = 1;
+        results.push_back(Benchmark::Measure("RandomizePositions", numEntities, 2 * sizeof(float), settings.repetitions, [&] { RandomizeJob::RandomizePositions(randomizedPositions, seed, 0, numEntities); }));
+        results.push_back(Benchmark::Measure("RandomizeVelocities", numEntities, 3 * sizeof(float), settings.repetitions, [&] { RandomizeJob::RandomizeVelocities(velocities, seed, 0, numEntities); }));
+        results.push_back(Benchmark::Measure("RandomizePhysics", numEntities, sizeof(float), settings.repetitions, [&] { RandomizeJob::RandomizePhysics(physics, seed, 0, numEntities); }));
+
+        // Reads six streams and writes four of them.
+        constexpr size_t motionBytesPerEntity = 10 * sizeof(float);
+        for (size_t kernelIndex = static_cast<size_t>(SimulateMotionJob::MotionKernel::SCALAR); kernelIndex < static_cast<size_t>(SimulateMotionJob::MotionKernel::NUM_KERNELS); kernelIndex++)
+        {
+            const SimulateMotionJob::MotionKernel kernel = static_cast<SimulateMotionJob::MotionKernel>(kernelIndex);
+            const SimulateMotionJob::UpdateMotionFunction updateMotion = SimulateMotionJob::GetKernelFunction(kernel);
+            if (updateMotion != nullptr)
+            {
+                results.push_back(Benchmark::Measure(std::string("UpdateMotion (") + SimulateMotionJob::GetKernelName(kernel) + ")", numEntities, motionBytesPerEntity, settings.repetitions, [&] { updateMotion(previousPositions, positions, velocities, physics, 0, numEntities, deltaTime); }));
+            }
+        }
+
+        // Reads the two position streams and writes a bin per entity, the randomized entities are all on screen so nothing is sorted.
+        SpatialBins bins = RenderJob::CreateVisibilityBins(arena, numEntities, SimulateMotionJob::GetGrainSize());
+        results.push_back(Benchmark::Measure("BinAll", numEntities, 2 * sizeof(float) + sizeof(uint8_t), settings.repetitions, [&] { bins.BinAll(positions); }));
+
+        // Reads the two position streams, writes a bucket, an index and a copy of both positions per entity and touches about one bucket offset and cursor each.
+        // Cells sized for about one entity each in the 20 by 20 area the entities are randomized into.
+        SpatialGrid grid(arena, numEntities, std::sqrt(400.0f / static_cast<float>(numEntities)));
+        results.push_back(Benchmark::Measure("SpatialGrid::Build", numEntities, 2 * sizeof(float) + 4 * sizeof(uint32_t) + 2 * sizeof(float), settings.repetitions, [&] { grid.Build(positions); }));
+
+        // Eight nearest neighbours of every 64th entity, reported per query.
+        constexpr size_t queryStride = 64;
+        constexpr size_t numNeighbours = 8;
+        std::array<uint32_t, numNeighbours> neighbours;
+        std::array<float, numNeighbours> neighbourDistances;
+        results.push_back(Benchmark::Measure("SpatialGrid::FindNearest", (numEntities + queryStride - 1) / queryStride, numNeighbours * (sizeof(uint32_t) + 2 * sizeof(float)), settings.repetitions, [&]
+        {
+            for (size_t i = 0; i < numEntities; i += queryStride)
+            {
+                grid.FindNearest(positions.x[i], positions.y[i], 1.0f, neighbours, neighbourDistances);
+            }
+        }));
+
+        RenderJob renderJob;
+        const std::span<DrawProperties> drawProperties = Entity::AllocateStream<DrawProperties>(arena, numEntities);
+        assert(arena.GetUsed() <= arenaBytes);
+        results.push_back(Benchmark::Measure("InitializeDrawProperties", numEntities, 2 * sizeof(float) + sizeof(DrawProperties), settings.repetitions, [&] { RenderJob::InitializeDrawProperties(drawProperties, velocities); }));
+        results.push_back(Benchmark::Measure("WriteEntities", numEntities, 2 * sizeof(float) + sizeof(DrawProperties), settings.repetitions, [&] { renderJob.DrawEntities(positions, drawProperties); }));
+        results.push_back(Benchmark::Measure("WriteEntitiesBinned", numEntities, 2 * sizeof(float) + sizeof(DrawProperties), settings.repetitions, [&] { renderJob.DrawEntities(positions, drawProperties, &bins); }));
+
+        RenderJob densityRenderJob(RenderMode::DENSITY);
+        results.push_back(Benchmark::Measure("WriteEntitiesDensity", numEntities, 2 * sizeof(float), settings.repetitions, [&] { densityRenderJob.DrawEntities(positions, drawProperties); }));
+
+        // Presenting doesn't depend on the number of entities, measure it once against the last world.
+        if (numEntities == settings.entityCounts.back())
+        {
+            results.push_back(Benchmark::Measure("SwapBuffers (ncurses)", RenderJob::GetNumCells(), sizeof(char), settings.repetitions, [&] { renderJob.Present(true); }));
+
+            RenderJob ansiRenderJob(RenderMode::DIRECTION, RenderBackend::ANSI);
+            ansiRenderJob.SetOutputFile(fileno(devNull));
+            ansiRenderJob.DrawEntities(positions, drawProperties);
+            results.push_back(Benchmark::Measure("SwapBuffers (ansi)", RenderJob::GetNumCells(), sizeof(char), settings.repetitions, [&] { ansiRenderJob.Present(true); }));
+        }
+    }
+
+    endwin();
+    delscreen(screen);
+    std::fclose(devNull);
+    JobSystem::ShutDown();
+
+    Benchmark::PrintTable(results);
+
+    if (!settings.jsonPath.empty())
+    {
+        Benchmark::WriteJson(results, settings.jsonPath);
+    }
+
+    if (!settings.csvPath.empty())
+    {
+        Benchmark::WriteCsv(results, settings.csvPath);
+    }
+
+    return 0;
+}
@@ -1,6 +1,9 @@
 #include "Clocks.h"
 
 #include <chrono>
+#include <array>
+#include <fstream>
+#include <iomanip>
 
 namespace Clocks
 {
@@ -16,7 +19,33 @@ namespace Clocks
     std::chrono::high_resolution_clock::time_point currentRenderThread;
     std::chrono::duration<float> totalRenderThread;
 
+    std::chrono::high_resolution_clock::time_point currentWait;
+    std::chrono::duration<float> totalWait;
+
     float deltaTime;
+    double simulatedTime = 0.0;
+
+    std::array<LatencyHistogram, static_cast<size_t>(Latency::NUM_LATENCIES)> latencyHistograms;
+
+    const std::array<const char*, static_cast<size_t>(Latency::NUM_LATENCIES)> latencyNames
+    {
+        "Frame",
+        "Sim",
+        "Render",
+        "Wait"
+    };
+
+    constexpr std::array<double, 4> reportedPercentiles{ 50.0, 90.0, 99.0, 99.9 };
+
+    void RecordLatency(const Latency latency, const std::chrono::high_resolution_clock::duration duration)
+    {
+        latencyHistograms[static_cast<size_t>(latency)].Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+    }
+
+    double ToMilliseconds(const uint64_t nanoseconds)
+    {
+        return static_cast<double>(nanoseconds) / 1000000.0;
+    }
 
     void StartAppClock()
     {
@@ -31,10 +60,12 @@ namespace Clocks
         currentFrame = std::chrono::high_resolution_clock::now();
         totalFrame = currentFrame - appStart;
         deltaTime = static_cast<std::chrono::duration<float>>(currentFrame - lastFrame).count();
+        simulatedTime += deltaTime;
     }
 
     void SavePreviousFrameClock()
     {
+        RecordLatency(Latency::FRAME, std::chrono::high_resolution_clock::now() - currentFrame);
         lastFrame = currentFrame;
     }
 
@@ -48,6 +79,16 @@ namespace Clocks
         return deltaTime;
     }
 
+    double GetSimulatedTime()
+    {
+        return simulatedTime;
+    }
+
+    void SetSimulatedTime(const double time)
+    {
+        simulatedTime = time;
+    }
+
     void StartSimClock()
     {
         currentSimThread = std::chrono::high_resolution_clock::now();
@@ -57,6 +98,7 @@ namespace Clocks
     {
         const std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
         totalSimThread += now - currentSimThread;
+        RecordLatency(Latency::SIM, now - currentSimThread);
     }
 
     float GetSimTime()
@@ -73,10 +115,96 @@ namespace Clocks
     {
         const std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
         totalRenderThread += now - currentRenderThread;
+        RecordLatency(Latency::RENDER, now - currentRenderThread);
     }
 
     float GetRenderTime()
     {
         return totalRenderThread.count();
     }
+
+    void StartWaitClock()
+    {
+        currentWait = std::chrono::high_resolution_clock::now();
+    }
+
+    void PauseWaitClock()
+    {
+        const std::chrono::high_resolution_clock::duration wait = std::chrono::high_resolution_clock::now() - currentWait;
+        totalWait += wait;
+        RecordLatency(Latency::WAIT, wait);
+    }
+
+    float GetWaitTime()
+    {
+        return totalWait.count();
+    }
+
+    const LatencyHistogram& GetLatencyHistogram(const Latency latency)
+    {
+        return latencyHistograms[static_cast<size_t>(latency)];
+    }
+
+    void PrintLatencyPercentiles(std::ostream& stream)
+    {
+        const std::streamsize previousPrecision = stream.precision();
+        for (size_t i = 0; i < latencyHistograms.size(); i++)
+        {
+            const LatencyHistogram& histogram = latencyHistograms[i];
+            if (histogram.GetCount() == 0)
+            {
+                continue;
+            }
+
+            stream << latencyNames[i] << " Time (ms):";
+            for (const double percentile : reportedPercentiles)
+            {
+                stream << " p" << percentile << " " << std::fixed << std::setprecision(3) << ToMilliseconds(histogram.GetValueAtPercentile(percentile)) << std::defaultfloat;
+            }
+            stream << " max " << std::fixed << std::setprecision(3) << ToMilliseconds(histogram.GetMax()) << std::defaultfloat << std::endl;
+        }
+        stream.precision(previousPrecision);
+    }
+
+    bool ExportLatencies(const std::string& path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        const bool isJson = path.ends_with(".json");
+        file << (isJson ? "{\n" : "latency,count,meanMs,p50Ms,p90Ms,p99Ms,p99.9Ms,maxMs\n");
+
+        for (size_t i = 0; i < latencyHistograms.size(); i++)
+        {
+            const LatencyHistogram& histogram = latencyHistograms[i];
+            if (isJson)
+            {
+                file << "  \"" << latencyNames[i] << "\": { \"count\": " << histogram.GetCount() << ", \"meanMs\": " << histogram.GetMean() / 1000000.0;
+                for (const double percentile : reportedPercentiles)
+                {
+                    file << ", \"p" << percentile << "Ms\": " << ToMilliseconds(histogram.GetValueAtPercentile(percentile));
+                }
+                file << ", \"maxMs\": " << ToMilliseconds(histogram.GetMax()) << " }" << (i + 1 < latencyHistograms.size() ? ",\n" : "\n");
+            }
+            else
+            {
+                file << latencyNames[i] << ',' << histogram.GetCount() << ',' << histogram.GetMean() / 1000000.0;
+                for (const double percentile : reportedPercentiles)
+                {
+                    file << ',' << ToMilliseconds(histogram.GetValueAtPercentile(percentile));
+                }
+                file << ',' << ToMilliseconds(histogram.GetMax()) << '\n';
+            }
+        }
+
+        if (isJson)
+        {
+            file << "}\n";
+        }
+
+        return true;
+    }
 }
\ No newline at end of file
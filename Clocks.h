@@ -1,5 +1,10 @@
 #pragma once
 
+#include <string>
+#include <ostream>
+
+#include "LatencyHistogram.h"
+
 namespace Clocks
 {
     void StartAppClock();
@@ -9,6 +14,10 @@ namespace Clocks
     float GetTotalTime();
     float GetDeltaTime();
 
+    // Time the simulation has advanced, the sum of every frame's delta time. Unlike the app clock it carries over when a snapshot is loaded.
+    double GetSimulatedTime();
+    void SetSimulatedTime(double simulatedTime);
+
     void StartSimClock();
     void PauseSimClock();
     float GetSimTime();
@@ -16,4 +25,26 @@ namespace Clocks
     void StartRenderClock();
     void PauseRenderClock();
     float GetRenderTime();
+
+    // Time the render loop spent waiting for the simulation to hand it a new frame.
+    void StartWaitClock();
+    void PauseWaitClock();
+    float GetWaitTime();
+
+    // Every frame's frame and sim times, and every rendered frame's render and wait times, are also recorded into a histogram each.
+    enum class Latency
+    {
+        FRAME,
+        SIM,
+        RENDER,
+        WAIT,
+
+        NUM_LATENCIES
+    };
+
+    const LatencyHistogram& GetLatencyHistogram(Latency latency);
+    void PrintLatencyPercentiles(std::ostream& stream);
+
+    // Writes the percentiles of every histogram to path, as JSON if it ends with .json and as CSV otherwise.
+    bool ExportLatencies(const std::string& path);
 };
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include "CollisionJob.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+#include "JobSystem.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+
+constexpr size_t grainSize = 8192;
+
+// Cells are as small as they can be while every entity a circle can touch is still in the 3x3 cells around it.
+CollisionJob::CollisionJob(Arena& arena, const size_t numEntities, const float radiusIn)
+    : grid(arena, numEntities, 2.0f * radiusIn), radius(radiusIn)
+{
+    sortedVelocityX = Entity::AllocateStream<float>(arena, numEntities);
+    sortedVelocityY = Entity::AllocateStream<float>(arena, numEntities);
+    deltaVelocityX = Entity::AllocateStream<float>(arena, numEntities);
+    deltaVelocityY = Entity::AllocateStream<float>(arena, numEntities);
+    contactShares = Entity::AllocateStream<float>(arena, numEntities);
+    isChunkBounced = Entity::AllocateStream<uint8_t>(arena, (numEntities + chunkSize - 1) / chunkSize);
+}
+
+size_t CollisionJob::GetArenaBytes(const size_t numEntities)
+{
+    return SpatialGrid::GetArenaBytes(numEntities) + 5 * Entity::GetStreamBytes<float>(numEntities) + Entity::GetStreamBytes<uint8_t>((numEntities + chunkSize - 1) / chunkSize);
+}
+
+void CollisionJob::Run(const Entity::Positions& positions, Entity::Velocities& velocities)
+{
+    numChunks = (positions.x.size() + chunkSize - 1) / chunkSize;
+    std::fill(isChunkBounced.begin(), isChunkBounced.begin() + static_cast<ptrdiff_t>(numChunks), 0);
+    grid.Build(positions);
+
+    const std::span<const uint32_t> sortedIndices = grid.GetSortedIndices();
+    JobSystem::ParallelFor(sortedIndices.size(), grainSize, [this, &velocities, sortedIndices](const size_t begin, const size_t end)
+    {
+        const PerfCounters::Scope scope(PerfCounters::Job::COLLIDE);
+        const Trace::Span span("Collide");
+        for (size_t sorted = begin; sorted < end; sorted++)
+        {
+            const uint32_t index = sortedIndices[sorted];
+            sortedVelocityX[sorted] = velocities.speed[index] * velocities.directionX[index];
+            sortedVelocityY[sorted] = velocities.speed[index] * velocities.directionY[index];
+        }
+    });
+
+    // Broad phase: the three cells of the rows above, at and below every cell. The cells of a row are neighbouring buckets, so every row is one range of the sorted streams,
+    // and since every cell in a bucket has its neighbours in the same buckets the ranges are shared by the whole bucket.
+    // Narrow phase: every entity in those ranges, with no check of which cell it's really in. Anything close enough to touch is in one of the nine cells,
+    // and anything else fails the distance test.
+    // Every entity first counts its contacts, every pair is then given a share of its bounce that neither entity's shares add up past one.
+    const size_t numBuckets = grid.GetNumBuckets();
+    JobSystem::ParallelFor(numBuckets, grainSize, [this](const size_t beginBucket, const size_t endBucket)
+    {
+        const PerfCounters::Scope scope(PerfCounters::Job::COLLIDE);
+        const Trace::Span span("Collide");
+        uint64_t chunkContacts = 0;
+        for (size_t bucket = beginBucket; bucket < endBucket; bucket++)
+        {
+            if (grid.GetBucketBegin(bucket) == grid.GetBucketEnd(bucket))
+            {
+                continue;
+            }
+
+            NeighbourRanges ranges;
+            const size_t numRanges = GetNeighbourRanges(bucket, ranges);
+            for (uint32_t self = grid.GetBucketBegin(bucket); self < grid.GetBucketEnd(bucket); self++)
+            {
+                uint32_t contacts = 0;
+                for (size_t range = 0; range < numRanges; range++)
+                {
+                    contacts += CountContacts(self, ranges[range].first, ranges[range].second);
+                }
+
+                contactShares[self] = contacts > 0 ? 1.0f / static_cast<float>(contacts) : 0.0f;
+                chunkContacts += contacts;
+            }
+        }
+
+        numContacts.fetch_add(chunkContacts, std::memory_order_relaxed);
+    });
+
+    JobSystem::ParallelFor(numBuckets, grainSize, [this](const size_t beginBucket, const size_t endBucket)
+    {
+        const PerfCounters::Scope scope(PerfCounters::Job::COLLIDE);
+        const Trace::Span span("Collide");
+        for (size_t bucket = beginBucket; bucket < endBucket; bucket++)
+        {
+            if (grid.GetBucketBegin(bucket) == grid.GetBucketEnd(bucket))
+            {
+                continue;
+            }
+
+            NeighbourRanges ranges;
+            const size_t numRanges = GetNeighbourRanges(bucket, ranges);
+            for (uint32_t self = grid.GetBucketBegin(bucket); self < grid.GetBucketEnd(bucket); self++)
+            {
+                ContactSums sums{};
+                if (contactShares[self] > 0.0f)
+                {
+                    for (size_t range = 0; range < numRanges; range++)
+                    {
+                        AccumulateContacts(self, ranges[range].first, ranges[range].second, sums);
+                    }
+                }
+
+                float deltaX = 0.0f;
+                float deltaY = 0.0f;
+                for (uint32_t lane = 0; lane < ContactSums::lanes; lane++)
+                {
+                    deltaX += sums.deltaX[lane];
+                    deltaY += sums.deltaY[lane];
+                }
+
+                deltaVelocityX[self] = deltaX;
+                deltaVelocityY[self] = deltaY;
+            }
+        }
+    });
+
+    // Every entity is in exactly one place of the sorted order, so the writes back never overlap.
+    JobSystem::ParallelFor(sortedIndices.size(), grainSize, [this, &velocities, sortedIndices](const size_t begin, const size_t end)
+    {
+        const PerfCounters::Scope scope(PerfCounters::Job::COLLIDE);
+        const Trace::Span span("Collide");
+        for (size_t sorted = begin; sorted < end; sorted++)
+        {
+            if (deltaVelocityX[sorted] == 0.0f && deltaVelocityY[sorted] == 0.0f)
+            {
+                continue;
+            }
+
+            const float velocityX = sortedVelocityX[sorted] + deltaVelocityX[sorted];
+            const float velocityY = sortedVelocityY[sorted] + deltaVelocityY[sorted];
+            const float speed = std::sqrt(velocityX * velocityX + velocityY * velocityY);
+            const uint32_t index = sortedIndices[sorted];
+            velocities.speed[index] = speed;
+            if (speed > 0.0f)
+            {
+                velocities.directionX[index] = velocityX / speed;
+                velocities.directionY[index] = velocityY / speed;
+            }
+
+            // Entities of the same chunk are written back on any worker.
+            std::atomic_ref<uint8_t>(isChunkBounced[index / chunkSize]).store(1, std::memory_order_relaxed);
+        }
+    });
+}
+
+std::span<const uint8_t> CollisionJob::GetBouncedChunks() const
+{
+    return isChunkBounced.first(numChunks);
+}
+
+float CollisionJob::GetRadius() const
+{
+    return radius;
+}
+
+uint64_t CollisionJob::GetNumContacts() const
+{
+    return numContacts.load(std::memory_order_relaxed);
+}
+
+size_t CollisionJob::GetNeighbourRanges(const size_t bucket, NeighbourRanges& ranges) const
+{
+    // A row that wraps around the end of the buckets is split in two.
+    const size_t numBuckets = grid.GetNumBuckets();
+    size_t numRanges = 0;
+    for (int32_t offsetY = -1; offsetY <= 1; offsetY++)
+    {
+        const size_t firstBucket = grid.GetNeighbourBucket(bucket, -1, offsetY);
+        const size_t lastBucket = grid.GetNeighbourBucket(bucket, 1, offsetY);
+        if (firstBucket <= lastBucket)
+        {
+            ranges[numRanges++] = { grid.GetBucketBegin(firstBucket), grid.GetBucketEnd(lastBucket) };
+        }
+        else
+        {
+            ranges[numRanges++] = { grid.GetBucketBegin(firstBucket), grid.GetBucketEnd(numBuckets - 1) };
+            ranges[numRanges++] = { grid.GetBucketBegin(0), grid.GetBucketEnd(lastBucket) };
+        }
+    }
+
+    return numRanges;
+}
+
+bool CollisionJob::IsContact(const float distanceSquared, const float diameterSquared, const float approach)
+{
+    return (distanceSquared < diameterSquared) & (distanceSquared > 0.0f) & (approach < 0.0f);
+}
+
+uint32_t CollisionJob::CountContacts(const uint32_t self, const uint32_t begin, const uint32_t end) const
+{
+    const float* positionsX = grid.GetSortedX().data();
+    const float* positionsY = grid.GetSortedY().data();
+    const float* velocitiesX = sortedVelocityX.data();
+    const float* velocitiesY = sortedVelocityY.data();
+    const float selfX = positionsX[self];
+    const float selfY = positionsY[self];
+    const float selfVelocityX = velocitiesX[self];
+    const float selfVelocityY = velocitiesY[self];
+    const float diameterSquared = 4.0f * radius * radius;
+
+    std::array<uint32_t, ContactSums::lanes> laneContacts{};
+    auto count = [&](const uint32_t other, const uint32_t lane)
+    {
+        const float offsetX = positionsX[other] - selfX;
+        const float offsetY = positionsY[other] - selfY;
+        const float distanceSquared = offsetX * offsetX + offsetY * offsetY;
+        const float approach = (velocitiesX[other] - selfVelocityX) * offsetX + (velocitiesY[other] - selfVelocityY) * offsetY;
+        laneContacts[lane] += IsContact(distanceSquared, diameterSquared, approach) ? 1 : 0;
+    };
+
+    uint32_t other = begin;
+    for (; other + ContactSums::lanes <= end; other += ContactSums::lanes)
+    {
+        for (uint32_t lane = 0; lane < ContactSums::lanes; lane++)
+        {
+            count(other + lane, lane);
+        }
+    }
+
+    for (uint32_t lane = 0; other < end; other++, lane++)
+    {
+        count(other, lane);
+    }
+
+    uint32_t contacts = 0;
+    for (uint32_t lane = 0; lane < ContactSums::lanes; lane++)
+    {
+        contacts += laneContacts[lane];
+    }
+
+    return contacts;
+}
+
+void CollisionJob::AccumulateContacts(const uint32_t self, const uint32_t begin, const uint32_t end, ContactSums& sums) const
+{
+    const float* positionsX = grid.GetSortedX().data();
+    const float* positionsY = grid.GetSortedY().data();
+    const float* velocitiesX = sortedVelocityX.data();
+    const float* velocitiesY = sortedVelocityY.data();
+    const float* shares = contactShares.data();
+    const float selfX = positionsX[self];
+    const float selfY = positionsY[self];
+    const float selfVelocityX = velocitiesX[self];
+    const float selfVelocityY = velocitiesY[self];
+    const float selfShare = shares[self];
+    const float diameterSquared = 4.0f * radius * radius;
+
+    // No early outs, contacts are picked with selects. Sums are kept in locals, writing them through sums every time would have to assume it aliases the streams.
+    std::array<float, ContactSums::lanes> laneDeltaX{};
+    std::array<float, ContactSums::lanes> laneDeltaY{};
+    auto accumulate = [&](const uint32_t other, const uint32_t lane)
+    {
+        const float offsetX = positionsX[other] - selfX;
+        const float offsetY = positionsY[other] - selfY;
+        const float distanceSquared = offsetX * offsetX + offsetY * offsetY;
+        const float approach = (velocitiesX[other] - selfVelocityX) * offsetX + (velocitiesY[other] - selfVelocityY) * offsetY;
+
+        // A full share swaps the two entities' velocities along the line between them. Both ends of a pair take the same share, the smaller of the two,
+        // so momentum is kept, and no entity takes more than one whole bounce, so every new velocity is a blend of the ones its bounces alone would give
+        // and the pairs can't add energy between them.
+        const bool isContact = IsContact(distanceSquared, diameterSquared, approach);
+        const float safeDistanceSquared = distanceSquared > 0.0f ? distanceSquared : 1.0f;
+        const float impulse = isContact ? std::min(selfShare, shares[other]) * approach / safeDistanceSquared : 0.0f;
+
+        laneDeltaX[lane] += impulse * offsetX;
+        laneDeltaY[lane] += impulse * offsetY;
+    };
+
+    uint32_t other = begin;
+    for (; other + ContactSums::lanes <= end; other += ContactSums::lanes)
+    {
+        for (uint32_t lane = 0; lane < ContactSums::lanes; lane++)
+        {
+            accumulate(other + lane, lane);
+        }
+    }
+
+    for (uint32_t lane = 0; other < end; other++, lane++)
+    {
+        accumulate(other, lane);
+    }
+
+    for (uint32_t lane = 0; lane < ContactSums::lanes; lane++)
+    {
+        sums.deltaX[lane] += laneDeltaX[lane];
+        sums.deltaY[lane] += laneDeltaY[lane];
+    }
+}
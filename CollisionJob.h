@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+#include "Arena.h"
+#include "Entity.h"
+#include "SpatialGrid.h"
+
+// Bounces entities off each other. Every entity is a circle of the same radius and mass, and overlapping entities that are moving towards each other
+// swap the parts of their velocities along the line between them, like billiard balls. Run by SimulateMotionJob once every entity has been moved.
+// Every entity only ever writes its own result, worked out from everyone's velocities before this frame's collisions, so the outcome doesn't depend on how the work was split.
+// An entity touching several others at once takes a share of every bounce rather than all of them, which keeps momentum and never adds energy.
+class CollisionJob
+{
+public:
+    CollisionJob(Arena& arena, size_t numEntities, float radius);
+
+    static size_t GetArenaBytes(size_t numEntities);
+
+    // Rebuilds the grid from positions and updates the speed and direction of every entity that hit another one. Runs across all workers and returns when done.
+    void Run(const Entity::Positions& positions, Entity::Velocities& velocities);
+
+    // Entities are flagged as bounced by chunks of this many.
+    static constexpr size_t chunkSize = 8192;
+
+    // A flag per chunk of the entities the last Run was given, set for every chunk holding an entity whose speed or direction it changed.
+    // Bounces change entities in place, wherever they are, so anything kept per entity that depends on their velocities has to look at these as well as at the swapped slots.
+    std::span<const uint8_t> GetBouncedChunks() const;
+
+    float GetRadius() const;
+    uint64_t GetNumContacts() const; // Every overlapping, approaching pair counted once per entity in it, over all runs.
+
+private:
+    // Every lane sums its own share of the entities and the lanes are added up in a fixed order at the end. Without that the compiler can't reorder
+    // the sums into vectors, and with it the result is the same on every instruction set.
+    struct ContactSums
+    {
+        static constexpr uint32_t lanes = 8;
+
+        std::array<float, lanes> deltaX;
+        std::array<float, lanes> deltaY;
+    };
+
+    // Ranges of the sorted streams holding the three rows of cells around every cell of a bucket, a row that wraps around takes two.
+    using NeighbourRanges = std::array<std::pair<uint32_t, uint32_t>, 6>;
+    size_t GetNeighbourRanges(size_t bucket, NeighbourRanges& ranges) const;
+
+    // Overlapping and moving towards each other. Entities sitting exactly on top of each other, itself included, have no line between them and are left alone.
+    // Approach is how fast the other entity closes in along the line between them, scaled by the distance, negative when they are approaching.
+    static bool IsContact(float distanceSquared, float diameterSquared, float approach);
+
+    // How many of the entities in sorted range [begin, end) one entity bounces off.
+    uint32_t CountContacts(uint32_t self, uint32_t begin, uint32_t end) const;
+
+    // Accumulates the velocity change of one entity from the entities in sorted range [begin, end), once every entity's contacts are counted.
+    void AccumulateContacts(uint32_t self, uint32_t begin, uint32_t end, ContactSums& sums) const;
+
+    SpatialGrid grid;
+    float radius;
+
+    // Velocities gathered into the grid's sorted order, and the change every entity gets.
+    std::span<float> sortedVelocityX;
+    std::span<float> sortedVelocityY;
+    std::span<float> deltaVelocityX;
+    std::span<float> deltaVelocityY;
+    std::span<float> contactShares; // 1 over how many entities every entity bounces off, 0 for none.
+
+    std::span<uint8_t> isChunkBounced;
+    size_t numChunks = 0;
+
+    std::atomic<uint64_t> numContacts{0};
+};
@@ -0,0 +1,245 @@
+#include "Config.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <charconv>
+
+#include "RasterizeJob.h"
+
+namespace Config
+{
+    bool ApplyOption(const std::string& key, const std::string& value, Settings& settings);
+
+    bool IsFlag(const std::string& key)
+    {
+        return key == "huge-pages" || key == "perf-counters";
+    }
+
+    template<typename T>
+    bool ParseInteger(const std::string& text, T& outValue)
+    {
+        const char* end = text.data() + text.size();
+        const auto [parsedEnd, error] = std::from_chars(text.data(), end, outValue);
+        return error == std::errc() && parsedEnd == end;
+    }
+
+    bool ParseFloat(const std::string& text, float& outValue)
+    {
+        const char* end = text.data() + text.size();
+        const auto [parsedEnd, error] = std::from_chars(text.data(), end, outValue);
+        return error == std::errc() && parsedEnd == end;
+    }
+
+    bool ParseBool(const std::string& text, bool& outValue)
+    {
+        if (text == "true" || text == "1" || text == "on")
+        {
+            outValue = true;
+            return true;
+        }
+
+        if (text == "false" || text == "0" || text == "off")
+        {
+            outValue = false;
+            return true;
+        }
+
+        return false;
+    }
+
+    std::string Trim(const std::string& text)
+    {
+        const size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos)
+        {
+            return "";
+        }
+
+        const size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    bool LoadFile(const std::string& path, Settings& settings)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "Could not open config file: " << path << std::endl;
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            line = Trim(line.substr(0, line.find('#')));
+            if (line.empty())
+            {
+                continue;
+            }
+
+            const size_t separator = line.find('=');
+            const std::string key = Trim(line.substr(0, separator));
+            const std::string value = separator == std::string::npos ? "true" : Trim(line.substr(separator + 1));
+            if (!ApplyOption(key, value, settings))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool ApplyOption(const std::string& key, const std::string& value, Settings& settings)
+    {
+        bool isValid = false;
+        if (key == "config")
+        {
+            return LoadFile(value, settings);
+        }
+        else if (key == "entities")
+        {
+            isValid = ParseInteger(value, settings.numEntities) && settings.numEntities > 0;
+        }
+        else if (key == "max-entities")
+        {
+            isValid = ParseInteger(value, settings.maxEntities);
+        }
+        else if (key == "grain-size")
+        {
+            isValid = ParseInteger(value, settings.grainSize) && settings.grainSize > 0;
+        }
+        else if (key == "seed")
+        {
+            isValid = ParseInteger(value, settings.seed);
+        }
+        else if (key == "huge-pages")
+        {
+            isValid = ParseBool(value, settings.useHugePages);
+        }
+        else if (key == "perf-counters")
+        {
+            isValid = ParseBool(value, settings.usePerfCounters);
+        }
+        else if (key == "render-mode")
+        {
+            isValid = value == "direction" || value == "density";
+            settings.renderMode = value == "density" ? RenderMode::DENSITY : RenderMode::DIRECTION;
+        }
+        else if (key == "render-backend")
+        {
+            isValid = RenderJob::ParseBackendName(value, settings.renderBackend);
+        }
+        else if (key == "simd-kernel")
+        {
+            isValid = SimulateMotionJob::ParseKernelName(value, settings.motionKernel);
+        }
+        else if (key == "latency-report")
+        {
+            settings.latencyReportPath = value;
+            isValid = !value.empty();
+        }
+        else if (key == "trace")
+        {
+            settings.tracePath = value;
+            isValid = value.ends_with(".json");
+        }
+        else if (key == "load-snapshot")
+        {
+            settings.loadSnapshotPath = value;
+            isValid = !value.empty();
+        }
+        else if (key == "save-snapshot")
+        {
+            settings.saveSnapshotPath = value;
+            isValid = !value.empty();
+        }
+        else if (key == "save-snapshot-frame")
+        {
+            isValid = ParseInteger(value, settings.saveSnapshotFrame);
+        }
+        else if (key == "collision-radius")
+        {
+            isValid = ParseFloat(value, settings.collisionRadius) && settings.collisionRadius >= 0.0f;
+        }
+        else if (key == "world-bounds")
+        {
+            isValid = ParseFloat(value, settings.worldBounds) && settings.worldBounds >= 0.0f;
+        }
+        else if (key == "record-trajectory")
+        {
+            settings.trajectoryPath = value;
+            isValid = !value.empty();
+        }
+        else if (key == "record-interval")
+        {
+            isValid = ParseInteger(value, settings.trajectoryInterval) && settings.trajectoryInterval > 0;
+        }
+        else if (key == "record-precision")
+        {
+            isValid = ParseFloat(value, settings.trajectoryPrecision) && settings.trajectoryPrecision > 0.0f;
+        }
+        else if (key == "record-images")
+        {
+            settings.imagePath = value;
+            isValid = value.ends_with(".pgm") || value.ends_with(".ppm");
+        }
+        else if (key == "image-interval")
+        {
+            isValid = ParseInteger(value, settings.imageInterval) && settings.imageInterval > 0;
+        }
+        else if (key == "image-width")
+        {
+            isValid = ParseInteger(value, settings.imageWidth) && settings.imageWidth > 0 && settings.imageWidth <= RasterizeJob::maxImageSize;
+        }
+        else if (key == "image-height")
+        {
+            isValid = ParseInteger(value, settings.imageHeight) && settings.imageHeight > 0 && settings.imageHeight <= RasterizeJob::maxImageSize;
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << key << std::endl;
+            return false;
+        }
+
+        if (!isValid)
+        {
+            std::cerr << "Invalid value for " << key << ": " << value << std::endl;
+        }
+
+        return isValid;
+    }
+
+    bool Parse(const int argc, char** argv, Settings& outSettings)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const std::string argument = argv[i];
+            if (argument.rfind("--", 0) != 0)
+            {
+                std::cerr << "Expected an option starting with --, got: " << argument << std::endl;
+                return false;
+            }
+
+            const std::string key = argument.substr(2);
+            std::string value = "true";
+            if (!IsFlag(key))
+            {
+                if (i + 1 >= argc)
+                {
+                    std::cerr << "Missing value for " << argument << std::endl;
+                    return false;
+                }
+
+                value = argv[++i];
+            }
+
+            if (!ApplyOption(key, value, outSettings))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Entity.h"
+#include "SimulateMotionJob.h"
+#include "RenderJob.h"
+#include "RandomizeJob.h"
+
+namespace Config
+{
+    struct Settings
+    {
+        size_t numEntities = Entity::defaultNumEntities;
+        size_t maxEntities = 0; // Room for spawned entities, zero leaves no more room than numEntities.
+        size_t grainSize = SimulateMotionJob::defaultGrainSize;
+        uint64_t seed = RandomizeJob::GenerateSeed();
+        bool useHugePages = false;
+        bool usePerfCounters = false;
+        std::string latencyReportPath;
+        std::string tracePath;
+        std::string loadSnapshotPath;
+        std::string saveSnapshotPath;
+        // Frame the snapshot is saved after, counted from the start of this run. Zero saves it at exit.
+        uint64_t saveSnapshotFrame = 0;
+        std::string trajectoryPath;
+        uint64_t trajectoryInterval = 1;
+        float trajectoryPrecision = 0.001f;
+        std::string imagePath;
+        uint64_t imageInterval = 60;
+        size_t imageWidth = 1920;
+        size_t imageHeight = 1080;
+        float collisionRadius = 0.0f; // Zero turns collisions off.
+        float worldBounds = 0.0f; // Entities further out than this on either axis are replaced with new ones, zero turns it off.
+        RenderMode renderMode = RenderMode::DIRECTION;
+        RenderBackend renderBackend = RenderBackend::NCURSES;
+        SimulateMotionJob::MotionKernel motionKernel = SimulateMotionJob::MotionKernel::AUTO;
+    };
+
+    // Options are given as "--key value", or just "--key" for flags. "--config <file>" reads a file with one "key = value" per line,
+    // using the same keys without the dashes. Everything is applied in order, so later options override earlier ones.
+    bool Parse(int argc, char** argv, Settings& outSettings);
+}
@@ -1,26 +1,109 @@
 #pragma once
 
 #include <cstddef>
+#include <span>
 
 #include "Vector.h"
+#include "Arena.h"
 
 namespace Entity
 {
-    constexpr size_t numEntities = 250000;
+    constexpr size_t defaultNumEntities = 250000;
 
-    struct Position
+    // Every component stream starts on its own cache line, which lets the SIMD kernels use aligned full width loads and stores.
+    constexpr size_t streamAlignment = 64;
+
+    struct Positions
     {
-        Vector2 pos;
+        std::span<float> x;
+        std::span<float> y;
     };
     
-    struct Velocity
+    struct Velocities
     {
-        float speed;
-        Vector2 direction;
+        std::span<float> speed;
+        std::span<float> directionX;
+        std::span<float> directionY;
     };
     
     struct Physics
     {
+        std::span<float> acceleration;
+    };
+
+    // Every component of a single entity, for creating entities one at a time.
+    struct State
+    {
+        float x;
+        float y;
+        float speed;
+        float directionX;
+        float directionY;
         float acceleration;
     };
+
+    template<typename T>
+    std::span<T> AllocateStream(Arena& arena, const size_t numEntities)
+    {
+        return arena.Allocate<T>(numEntities, streamAlignment);
+    }
+
+    // Arena memory a stream takes, with the padding up to where the next stream starts.
+    template<typename T>
+    constexpr size_t GetStreamBytes(const size_t numEntities)
+    {
+        return (numEntities * sizeof(T) + streamAlignment - 1) / streamAlignment * streamAlignment;
+    }
+
+    inline Positions AllocatePositions(Arena& arena, const size_t numEntities)
+    {
+        return Positions{ AllocateStream<float>(arena, numEntities), AllocateStream<float>(arena, numEntities) };
+    }
+
+    inline Velocities AllocateVelocities(Arena& arena, const size_t numEntities)
+    {
+        return Velocities{ AllocateStream<float>(arena, numEntities), AllocateStream<float>(arena, numEntities), AllocateStream<float>(arena, numEntities) };
+    }
+
+    inline Physics AllocatePhysics(Arena& arena, const size_t numEntities)
+    {
+        return Physics{ AllocateStream<float>(arena, numEntities) };
+    }
+
+    inline size_t GetPositionsBytes(const size_t numEntities)
+    {
+        return 2 * GetStreamBytes<float>(numEntities);
+    }
+
+    inline size_t GetVelocitiesBytes(const size_t numEntities)
+    {
+        return 3 * GetStreamBytes<float>(numEntities);
+    }
+
+    inline size_t GetPhysicsBytes(const size_t numEntities)
+    {
+        return GetStreamBytes<float>(numEntities);
+    }
+
+    // Arena memory of the components the simulation keeps, two frames of positions, the one it moves on from and the one it writes, and the rest once.
+    inline size_t GetWorldBytes(const size_t numEntities)
+    {
+        return 2 * GetPositionsBytes(numEntities) + GetVelocitiesBytes(numEntities) + GetPhysicsBytes(numEntities);
+    }
+
+    // Views of the first numEntities entities, streams are allocated for the most entities there can be and only the live ones are handed to jobs.
+    inline Positions GetFirst(const Positions& positions, const size_t numEntities)
+    {
+        return Positions{ positions.x.first(numEntities), positions.y.first(numEntities) };
+    }
+
+    inline Velocities GetFirst(const Velocities& velocities, const size_t numEntities)
+    {
+        return Velocities{ velocities.speed.first(numEntities), velocities.directionX.first(numEntities), velocities.directionY.first(numEntities) };
+    }
+
+    inline Physics GetFirst(const Physics& physics, const size_t numEntities)
+    {
+        return Physics{ physics.acceleration.first(numEntities) };
+    }
 }
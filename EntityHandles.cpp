@@ -0,0 +1,103 @@
+#include "EntityHandles.h"
+
+#include <algorithm>
+
+EntityHandles::EntityHandles(const size_t capacity, const size_t numLive)
+    : generations(capacity, 0), isAlive(capacity, 0), numAlive(numLive)
+{
+    std::fill(isAlive.begin(), isAlive.begin() + static_cast<ptrdiff_t>(numLive), 1);
+
+    freeIds.reserve(capacity);
+    for (size_t id = capacity; id > numLive; id--)
+    {
+        freeIds.push_back(static_cast<uint32_t>(id - 1));
+    }
+
+    // Every id can be requested once in each direction before a batch would have to grow, more only when ids are reused within a frame.
+    spawnRequests.reserve(capacity);
+    despawnRequests.reserve(capacity);
+}
+
+EntityHandle EntityHandles::GetHandle(const uint32_t entityId) const
+{
+    return EntityHandle{ entityId, generations[entityId] };
+}
+
+bool EntityHandles::IsAlive(const EntityHandle handle) const
+{
+    return handle.id < generations.size() && generations[handle.id] == handle.generation && isAlive[handle.id] != 0;
+}
+
+size_t EntityHandles::GetNumAlive() const
+{
+    return numAlive;
+}
+
+EntityHandle EntityHandles::Spawn(const Entity::State& state)
+{
+    if (freeIds.empty())
+    {
+        return EntityHandle{};
+    }
+
+    const uint32_t id = freeIds.back();
+    freeIds.pop_back();
+    isAlive[id] = 1;
+    numAlive++;
+
+    const EntityHandle handle = GetHandle(id);
+    spawnRequests.emplace_back(handle, state);
+    return handle;
+}
+
+void EntityHandles::Despawn(const EntityHandle handle)
+{
+    if (!IsAlive(handle))
+    {
+        return;
+    }
+
+    // The id is free again right away, the despawn is always applied before any spawn that reuses it.
+    generations[handle.id]++;
+    isAlive[handle.id] = 0;
+    freeIds.push_back(handle.id);
+    numAlive--;
+    despawnRequests.push_back(handle.id);
+}
+
+void EntityHandles::Apply(ActiveSet& activeSet, PositionFrame& frame, const std::span<PositionFrame> frames, Entity::Velocities& velocities, Entity::Physics& physics)
+{
+    activeSet.BeginChanges();
+
+    for (const uint32_t id : despawnRequests)
+    {
+        if (activeSet.GetSlot(id) < activeSet.GetNumLive())
+        {
+            activeSet.Despawn(id, frame, velocities, physics);
+            numDespawned++;
+        }
+    }
+
+    for (const auto& [handle, state] : spawnRequests)
+    {
+        if (IsAlive(handle))
+        {
+            activeSet.Spawn(handle.id, state, frame, velocities, physics);
+            numSpawned++;
+        }
+    }
+
+    activeSet.EndChanges(frame, frames);
+    spawnRequests.clear();
+    despawnRequests.clear();
+}
+
+uint64_t EntityHandles::GetNumSpawned() const
+{
+    return numSpawned;
+}
+
+uint64_t EntityHandles::GetNumDespawned() const
+{
+    return numDespawned;
+}
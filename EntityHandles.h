@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "Entity.h"
+#include "PositionFrame.h"
+#include "ActiveSet.h"
+
+// Refers to one entity for as long as it lives. Ids are reused once an entity is despawned, the generation tells the entities that had the same id apart.
+struct EntityHandle
+{
+    static constexpr uint32_t invalidId = std::numeric_limits<uint32_t>::max();
+
+    uint32_t id = invalidId;
+    uint32_t generation = 0;
+};
+
+// Hands out entity ids and keeps track of which entities are alive. Spawns and despawns are only requests, they are queued up during a frame
+// and applied all at once by Apply between frames, so no job ever sees an entity appear or disappear halfway through a frame.
+// A handle is alive from the moment it is spawned until it is despawned, even when that happens before the entity has been applied.
+// Not thread safe, requests have to come from one job at a time.
+class EntityHandles
+{
+public:
+    // Entities [0, numLive) are alive to begin with, the ids up to capacity are free.
+    EntityHandles(size_t capacity, size_t numLive);
+
+    EntityHandle GetHandle(uint32_t entityId) const;
+    bool IsAlive(EntityHandle handle) const;
+    size_t GetNumAlive() const;
+
+    // Returns the handle of the new entity right away, or an invalid handle when every id is taken.
+    EntityHandle Spawn(const Entity::State& state);
+
+    // Does nothing for handles that aren't alive any more, so an entity can safely be despawned twice.
+    void Despawn(EntityHandle handle);
+
+    // Between frames, while no job runs: despawns and then spawns everything requested since the last call, see ActiveSet::BeginChanges.
+    // Whatever the renderer and other per entity state keep by slot has to be updated from the active set's swaps afterwards.
+    void Apply(ActiveSet& activeSet, PositionFrame& frame, std::span<PositionFrame> frames, Entity::Velocities& velocities, Entity::Physics& physics);
+
+    uint64_t GetNumSpawned() const; // Applied spawns and despawns over the whole run.
+    uint64_t GetNumDespawned() const;
+
+private:
+    std::vector<uint32_t> generations;
+    std::vector<uint8_t> isAlive;
+    std::vector<uint32_t> freeIds; // Lowest id last, so ids are handed out in order.
+    size_t numAlive;
+
+    // An id can be despawned and spawned again before the requests are applied, a spawn that is no longer alive is skipped,
+    // and so is the despawn of an id that never made it into the active set.
+    std::vector<std::pair<EntityHandle, Entity::State>> spawnRequests;
+    std::vector<uint32_t> despawnRequests;
+
+    uint64_t numSpawned = 0;
+    uint64_t numDespawned = 0;
+};
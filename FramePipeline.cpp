@@ -0,0 +1,138 @@
+#include "FramePipeline.h"
+
+#include <algorithm>
+
+#include "JobSystem.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+
+FramePipeline::FramePipeline(Arena& arena, const size_t capacity, const size_t chunkSizeIn, const Entity::Velocities& velocities)
+    : chunkSize(chunkSizeIn),
+    drawProperties(Entity::AllocateStream<DrawProperties>(arena, capacity)),
+    renderFrames{ CreateRenderFrame(arena, capacity, chunkSizeIn), CreateRenderFrame(arena, capacity, chunkSizeIn), CreateRenderFrame(arena, capacity, chunkSizeIn) },
+    frames(0, 1, 2)
+{
+    RenderJob::InitializeDrawProperties(drawProperties, velocities);
+
+    // Nothing has been copied into any of the render frames yet, every chunk starts out stale.
+    const size_t numChunks = (capacity + chunkSize - 1) / chunkSize;
+    for (size_t i = 0; i < numFrames; i++)
+    {
+        isChunkStale[i] = Entity::AllocateStream<uint8_t>(arena, numChunks);
+        std::fill(isChunkStale[i].begin(), isChunkStale[i].end(), 1);
+    }
+}
+
+size_t FramePipeline::GetArenaBytes(const size_t capacity, const size_t chunkSize)
+{
+    const size_t renderFrameBytes = Entity::GetPositionsBytes(capacity) + RenderJob::GetVisibilityBinsArenaBytes(capacity, chunkSize) + Entity::GetStreamBytes<DrawProperties>(capacity);
+    return Entity::GetStreamBytes<DrawProperties>(capacity) + numFrames * (renderFrameBytes + Entity::GetStreamBytes<uint8_t>((capacity + chunkSize - 1) / chunkSize));
+}
+
+RenderFrame FramePipeline::CreateRenderFrame(Arena& arena, const size_t capacity, const size_t chunkSize)
+{
+    return RenderFrame{ PositionFrame{ Entity::AllocatePositions(arena, capacity), RenderJob::CreateVisibilityBins(arena, capacity, chunkSize) }, Entity::AllocateStream<DrawProperties>(arena, capacity) };
+}
+
+void FramePipeline::UpdateDrawProperties(const Entity::Velocities& velocities, const ActiveSet& activeSet, const CollisionJob* collisions)
+{
+    RenderJob::UpdateDrawProperties(drawProperties, velocities, activeSet);
+    if (collisions == nullptr)
+    {
+        return;
+    }
+
+    // Chunks are redrawn whole from the velocities in their slots, which is right whether or not Compact moved a bounced entity out of one since.
+    const std::span<const uint8_t> isBounced = collisions->GetBouncedChunks();
+    JobSystem::ParallelFor(isBounced.size(), 1, [this, &velocities, isBounced](const size_t beginChunk, const size_t endChunk)
+    {
+        for (size_t chunk = beginChunk; chunk < endChunk; chunk++)
+        {
+            if (isBounced[chunk] != 0)
+            {
+                const size_t begin = chunk * CollisionJob::chunkSize;
+                RenderJob::UpdateDrawProperties(drawProperties, velocities, begin, std::min(begin + CollisionJob::chunkSize, drawProperties.size()));
+            }
+        }
+    });
+}
+
+void FramePipeline::MarkChanged(const size_t end, const ActiveSet& activeSet)
+{
+    // The render frame the renderer is drawing is marked as well, it is copied into again once the renderer has let go of it.
+    const size_t endChunk = (end + chunkSize - 1) / chunkSize;
+    for (const std::span<uint8_t> isStale : isChunkStale)
+    {
+        std::fill(isStale.begin(), isStale.begin() + static_cast<ptrdiff_t>(endChunk), 1);
+        activeSet.ForEachSwappedSlot([this, isStale](const uint32_t slot)
+        {
+            isStale[slot / chunkSize] = 1;
+        });
+    }
+}
+
+void FramePipeline::Publish(const PositionFrame& frame, const size_t numEntities, const uint64_t frameIndex)
+{
+    const size_t writeIndex = frames.GetWriteBuffer();
+    RenderFrame& renderFrame = renderFrames[writeIndex];
+    const std::span<uint8_t> isStale = isChunkStale[writeIndex];
+
+    const size_t numChunks = (numEntities + chunkSize - 1) / chunkSize;
+    JobSystem::ParallelFor(numChunks, 1, [this, &frame, &renderFrame, isStale, numEntities](const size_t beginChunk, const size_t endChunk)
+    {
+        const PerfCounters::Scope scope(PerfCounters::Job::HAND_OFF);
+        for (size_t chunk = beginChunk; chunk < endChunk; chunk++)
+        {
+            if (isStale[chunk] == 0)
+            {
+                continue;
+            }
+
+            const size_t begin = chunk * chunkSize;
+            const size_t end = std::min(begin + chunkSize, numEntities);
+            std::copy(frame.positions.x.begin() + begin, frame.positions.x.begin() + end, renderFrame.frame.positions.x.begin() + begin);
+            std::copy(frame.positions.y.begin() + begin, frame.positions.y.begin() + end, renderFrame.frame.positions.y.begin() + begin);
+            std::copy(drawProperties.begin() + begin, drawProperties.begin() + end, renderFrame.drawProperties.begin() + begin);
+            renderFrame.frame.bins.CopyChunk(frame.bins, chunk);
+            isStale[chunk] = 0;
+        }
+    });
+
+    renderFrame.numEntities = numEntities;
+    renderFrame.frameIndex = frameIndex;
+    frames.Publish();
+    numPublished++;
+
+    numSignals.fetch_add(1, std::memory_order_release);
+    numSignals.notify_one();
+}
+
+void FramePipeline::Stop()
+{
+    isStopped.store(true, std::memory_order_relaxed);
+    numSignals.fetch_add(1, std::memory_order_release);
+    numSignals.notify_one();
+}
+
+uint64_t FramePipeline::GetNumPublished() const
+{
+    return numPublished;
+}
+
+uint64_t FramePipeline::GetNumDropped() const
+{
+    return frames.GetNumDropped();
+}
+
+const RenderFrame* FramePipeline::AcquireNext()
+{
+    const Trace::Span span("WaitForFrame");
+    numSignals.wait(numSignalsSeen, std::memory_order_acquire);
+    numSignalsSeen = numSignals.load(std::memory_order_acquire);
+    if (isStopped.load(std::memory_order_relaxed))
+    {
+        return nullptr;
+    }
+
+    return &renderFrames[frames.Acquire()];
+}
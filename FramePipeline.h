@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "Arena.h"
+#include "Entity.h"
+#include "PositionFrame.h"
+#include "ActiveSet.h"
+#include "CollisionJob.h"
+#include "RenderJob.h"
+#include "TripleBuffer.h"
+
+// A frame as the render loop sees it: the live entities' positions, their bins and what is drawn for every one of them.
+struct RenderFrame
+{
+    PositionFrame frame; // Streams are allocated for the most entities there can be, only the first numEntities are part of the frame.
+    std::span<DrawProperties> drawProperties;
+    size_t numEntities = 0;
+    uint64_t frameIndex = 0;
+};
+
+// Hands finished frames from the simulation loop over to a render loop on a thread of its own, so neither ever waits on the other.
+// Frames are copied out of the simulation's buffers into three render frames exchanged through a lock free triple buffer: the simulation always has one to write,
+// and the renderer always picks up the newest one. Frames the renderer was too slow to pick up are dropped.
+// Only the chunks that changed since a render frame was last written are copied into it, once most entities have come to rest a frame costs next to nothing to hand over.
+class FramePipeline
+{
+public:
+    // Render frames, every one with positions, bins and draw properties of its own.
+    static constexpr size_t numFrames = 3;
+
+    FramePipeline(Arena& arena, size_t capacity, size_t chunkSize, const Entity::Velocities& velocities);
+
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+
+    static size_t GetArenaBytes(size_t capacity, size_t chunkSize);
+
+    // Simulation side. Keeps what is drawn for every entity in the same slots as the entity, after every Compact and batch of changes,
+    // and in step with the directions of the entities collisions bounced when they ran this frame.
+    void UpdateDrawProperties(const Entity::Velocities& velocities, const ActiveSet& activeSet, const CollisionJob* collisions = nullptr);
+
+    // Simulation side. The chunks of [0, end) were written, and the slots the last Compact or batch of changes swapped.
+    void MarkChanged(size_t end, const ActiveSet& activeSet);
+
+    // Simulation side. Copies every changed chunk of the first numEntities entities of frame into a free render frame and hands it to the renderer.
+    // Runs across all workers and returns when the frame has been handed over.
+    void Publish(const PositionFrame& frame, size_t numEntities, uint64_t frameIndex);
+
+    // Simulation side. Wakes the renderer up for good, AcquireNext returns nullptr from then on.
+    void Stop();
+
+    uint64_t GetNumPublished() const;
+    uint64_t GetNumDropped() const;
+
+    // Render side. Waits until there is a frame newer than the last one acquired and returns the newest one, it stays valid until the next call.
+    const RenderFrame* AcquireNext();
+
+private:
+    static RenderFrame CreateRenderFrame(Arena& arena, size_t capacity, size_t chunkSize);
+
+    size_t chunkSize;
+    std::span<DrawProperties> drawProperties;
+    std::array<RenderFrame, numFrames> renderFrames;
+    std::array<std::span<uint8_t>, numFrames> isChunkStale; // Per render frame, only ever touched by the simulation side.
+    TripleBuffer<size_t> frames; // Indices into renderFrames.
+
+    // Bumped by every Publish and by Stop, the renderer sleeps on it.
+    std::atomic<uint64_t> numSignals{0};
+    std::atomic<bool> isStopped{false};
+    uint64_t numPublished = 0;
+    uint64_t numSignalsSeen = 0; // Render side.
+};
@@ -0,0 +1,80 @@
+#include "JobGraph.h"
+
+#include "Trace.h"
+
+void JobGraph::Run(JobSystem::Fence& fence)
+{
+    // Every counter is reset before the first job is submitted, a job finishing early would otherwise release a dependent that hasn't been reset yet.
+    runFence = &fence;
+    for (Node& node : nodes)
+    {
+        node.numPendingDependencies.store(static_cast<uint32_t>(node.dependencies.size()), std::memory_order_relaxed);
+    }
+
+    for (uint32_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i].dependencies.empty())
+        {
+            Submit(i);
+        }
+    }
+}
+
+JobGraph::ComponentSet JobGraph::ToSet(const std::initializer_list<Component> components)
+{
+    ComponentSet set = 0;
+    for (const Component component : components)
+    {
+        set |= ComponentSet{1} << static_cast<uint32_t>(component);
+    }
+
+    return set;
+}
+
+void JobGraph::AddJob(const char* name, const std::initializer_list<Component> reads, const std::initializer_list<Component> writes, const JobSystem::Job& job)
+{
+    Node& node = nodes.emplace_back();
+    node.name = name;
+    node.reads = ToSet(reads);
+    node.writes = ToSet(writes);
+    node.job = job;
+
+    // Reading what an earlier job writes, writing what it reads and writing what it writes all have to wait for it. Two reads never do.
+    const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size() - 1);
+    for (uint32_t i = 0; i < nodeIndex; i++)
+    {
+        Node& earlier = nodes[i];
+        if ((earlier.writes & (node.reads | node.writes)) != 0 || (earlier.reads & node.writes) != 0)
+        {
+            node.dependencies.push_back(i);
+            earlier.dependents.push_back(nodeIndex);
+        }
+    }
+}
+
+void JobGraph::Submit(const uint32_t nodeIndex)
+{
+    JobSystem::Submit(*runFence, [this, nodeIndex]
+    {
+        RunNode(nodeIndex);
+    });
+}
+
+void JobGraph::RunNode(const uint32_t nodeIndex)
+{
+    const Node& node = nodes[nodeIndex];
+    {
+        const Trace::Span span(node.name);
+        node.job.invoke(node.job.storage.data());
+    }
+
+    // Submitted before this job counts as finished on the fence, so the fence never drains while a dependent is still to come.
+    // The last dependency to finish submits the job, acquire and release on the counter make every dependency's writes visible to it.
+    for (const uint32_t dependent : node.dependents)
+    {
+        if (nodes[dependent].numPendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            Submit(dependent);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <vector>
+
+#include "JobSystem.h"
+
+// The data jobs of a frame share. The frame components name a role rather than a buffer, the frame buffers swap behind them every frame.
+enum class Component
+{
+    PUBLISHED_POSITIONS, // The last published frame, what the simulation moves on from.
+    PUBLISHED_BINS,
+    POSITIONS, // The frame being simulated.
+    BINS,
+    VELOCITIES,
+    PHYSICS,
+    ACTIVE_SET, // Which entities are moving, and the swaps that got them there this frame.
+    ENTITY_ORDER, // Per entity state outside the simulation that follows the published frame's order, like entity ids and what is drawn for every entity.
+    ENTITY_COMMANDS, // Spawns and despawns requested during the frame, applied once it is done.
+
+    NUM_COMPONENTS
+};
+
+// The jobs of a frame and the components every one of them reads and writes. Jobs are added once at startup in the order they would run in on one thread,
+// and a job waits for an earlier one only when one of them writes something the other reads or writes. Everything else runs at the same time.
+class JobGraph
+{
+public:
+    JobGraph() = default;
+    JobGraph(const JobGraph&) = delete;
+    JobGraph& operator=(const JobGraph&) = delete;
+
+    // The function runs to completion on whichever thread picks it up, it can split its work further with JobSystem::ParallelFor.
+    // It is stored inline like any other job, so its captures must be trivially copyable, typically references to state that changes between frames.
+    template<typename Function>
+    void Add(const char* name, std::initializer_list<Component> reads, std::initializer_list<Component> writes, const Function& function)
+    {
+        AddJob(name, reads, writes, JobSystem::MakeJob(function));
+    }
+
+    // Submits the jobs that depend on nothing against fence, the others are submitted against it as soon as their last dependency finishes.
+    // The frame is done once fence has been waited on, the graph must not be run again before that.
+    void Run(JobSystem::Fence& fence);
+
+private:
+    using ComponentSet = uint32_t;
+    static_assert(static_cast<size_t>(Component::NUM_COMPONENTS) <= 32, "ComponentSet has one bit per component.");
+
+    struct Node
+    {
+        const char* name;
+        ComponentSet reads;
+        ComponentSet writes;
+        JobSystem::Job job;
+
+        std::vector<uint32_t> dependencies;
+        std::vector<uint32_t> dependents;
+        std::atomic<uint32_t> numPendingDependencies{0};
+    };
+
+    static ComponentSet ToSet(std::initializer_list<Component> components);
+
+    void AddJob(const char* name, std::initializer_list<Component> reads, std::initializer_list<Component> writes, const JobSystem::Job& job);
+    void Submit(uint32_t nodeIndex);
+    void RunNode(uint32_t nodeIndex);
+
+    // Nodes never move once added, their counters are shared with the workers.
+    std::deque<Node> nodes;
+    JobSystem::Fence* runFence = nullptr;
+};
@@ -0,0 +1,157 @@
+#include "JobSystem.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "Trace.h"
+
+namespace JobSystem
+{
+    constexpr size_t queueCapacity = 1024;
+
+    std::array<Job, queueCapacity> queue;
+    size_t queueHead = 0;
+    size_t queueSize = 0;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+
+    std::vector<std::thread> workers;
+    bool isShuttingDown = false;
+
+    void Execute(const Job& job)
+    {
+        job.invoke(job.storage.data());
+        job.fence->pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    Job PopUnlocked()
+    {
+        const Job job = queue[queueHead];
+        queueHead = (queueHead + 1) % queueCapacity;
+        queueSize--;
+        return job;
+    }
+
+    bool TryPop(Job& outJob)
+    {
+        std::lock_guard lock(queueMutex);
+        if (queueSize == 0)
+        {
+            return false;
+        }
+
+        outJob = PopUnlocked();
+        return true;
+    }
+
+    void WorkerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock lock(queueMutex);
+                queueCondition.wait(lock, [] { return queueSize > 0 || isShuttingDown; });
+                if (queueSize == 0)
+                {
+                    return;
+                }
+
+                job = PopUnlocked();
+            }
+
+            Execute(job);
+        }
+    }
+
+    void Initialize(size_t numWorkers)
+    {
+        if (numWorkers == 0)
+        {
+            // The thread calling Wait helps out with the work, so leave one core for it.
+            const size_t numCores = std::thread::hardware_concurrency();
+            numWorkers = numCores > 1 ? numCores - 1 : 1;
+        }
+
+        isShuttingDown = false;
+        workers.reserve(numWorkers);
+        for (size_t i = 0; i < numWorkers; i++)
+        {
+            workers.emplace_back(&WorkerLoop);
+        }
+    }
+
+    void ShutDown()
+    {
+        {
+            std::lock_guard lock(queueMutex);
+            isShuttingDown = true;
+        }
+        queueCondition.notify_all();
+
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    size_t GetNumWorkers()
+    {
+        return workers.size();
+    }
+
+    void Submit(Fence& fence, const Job& job)
+    {
+        fence.pending.fetch_add(1, std::memory_order_relaxed);
+
+        Job queuedJob = job;
+        queuedJob.fence = &fence;
+
+        bool isQueued = false;
+        {
+            std::lock_guard lock(queueMutex);
+            if (queueSize < queueCapacity)
+            {
+                queue[(queueHead + queueSize) % queueCapacity] = queuedJob;
+                queueSize++;
+                isQueued = true;
+            }
+        }
+
+        // The queue is full, run the job right away instead of growing it.
+        if (!isQueued)
+        {
+            Execute(queuedJob);
+            return;
+        }
+
+        queueCondition.notify_one();
+    }
+
+    void Wait(Fence& fence)
+    {
+        // Jobs this thread helps out with show up nested inside the join, the gaps between them are time spent idle.
+        if (fence.pending.load(std::memory_order_acquire) == 0)
+        {
+            return;
+        }
+
+        const Trace::Span span("Wait");
+        while (fence.pending.load(std::memory_order_acquire) > 0)
+        {
+            // Help out with queued work instead of sleeping, this also makes it safe to wait from inside a job.
+            Job job;
+            if (TryPop(job))
+            {
+                Execute(job);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
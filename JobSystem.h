@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace JobSystem
+{
+    // A fence counts the jobs submitted against it that have not finished yet.
+    // It is owned by the caller and can be reused every frame once it has been waited on.
+    struct Fence
+    {
+        std::atomic<size_t> pending{0};
+    };
+
+    // Jobs are stored by value inside the fixed size job queue, so submitting never allocates.
+    // Anything captured by the callable must be trivially copyable and fit in the inline storage.
+    struct Job
+    {
+        static constexpr size_t storageSize = 48;
+
+        alignas(std::max_align_t) std::array<std::byte, storageSize> storage;
+        void (*invoke)(const void* storage) = nullptr;
+        Fence* fence = nullptr;
+    };
+
+    void Initialize(size_t numWorkers = 0);
+    void ShutDown();
+    size_t GetNumWorkers();
+
+    void Submit(Fence& fence, const Job& job);
+    void Wait(Fence& fence);
+
+    // Stores a callable in a job without queueing it, so it can be kept around and submitted later.
+    template<typename Function>
+    Job MakeJob(const Function& function)
+    {
+        static_assert(sizeof(Function) <= Job::storageSize, "Job captures too much state to be stored inline.");
+        static_assert(alignof(Function) <= alignof(std::max_align_t), "Job captures are over aligned.");
+        static_assert(std::is_trivially_copyable_v<Function>, "Job captures must be trivially copyable.");
+
+        Job job;
+        new (job.storage.data()) Function(function);
+        job.invoke = [](const void* storage)
+        {
+            (*static_cast<const Function*>(storage))();
+        };
+
+        return job;
+    }
+
+    template<typename Function>
+    void Submit(Fence& fence, const Function& function)
+    {
+        Submit(fence, MakeJob(function));
+    }
+
+    // Splits [0, count) into chunks of grainSize and runs function(begin, end) on them across all workers and the calling thread.
+    // Chunks are handed out dynamically, so only one job per worker is queued no matter how many chunks there are. Returns when every chunk is done.
+    template<typename Function>
+    void ParallelFor(const size_t count, const size_t grainSize, const Function& function)
+    {
+        struct Chunks
+        {
+            std::atomic<size_t> nextBegin{0};
+            size_t count;
+            size_t grainSize;
+            const Function* function;
+        };
+
+        Chunks chunks;
+        chunks.count = count;
+        chunks.grainSize = std::max<size_t>(grainSize, 1);
+        chunks.function = &function;
+
+        auto runChunks = [sharedChunks = &chunks]
+        {
+            while (true)
+            {
+                const size_t begin = sharedChunks->nextBegin.fetch_add(sharedChunks->grainSize, std::memory_order_relaxed);
+                if (begin >= sharedChunks->count)
+                {
+                    return;
+                }
+
+                (*sharedChunks->function)(begin, std::min(begin + sharedChunks->grainSize, sharedChunks->count));
+            }
+        };
+
+        const size_t numChunks = (count + chunks.grainSize - 1) / chunks.grainSize;
+        const size_t numHelpers = std::min(numChunks, GetNumWorkers() + 1);
+
+        Fence fence;
+        for (size_t i = 1; i < numHelpers; i++)
+        {
+            Submit(fence, runChunks);
+        }
+
+        runChunks();
+        Wait(fence);
+    }
+}
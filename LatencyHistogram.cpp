@@ -0,0 +1,70 @@
+#include "LatencyHistogram.h"
+
+#include <bit>
+#include <algorithm>
+
+size_t LatencyHistogram::GetBucketIndex(const uint64_t value)
+{
+    // Values below 2 * subBucketCount get a bucket each, above that every doubling shifts out one more bit of precision.
+    const uint32_t magnitude = static_cast<uint32_t>(std::max<int>(std::bit_width(value) - static_cast<int>(subBucketBits + 1), 0));
+    return (static_cast<size_t>(magnitude) << subBucketBits) + static_cast<size_t>(value >> magnitude);
+}
+
+uint64_t LatencyHistogram::GetBucketHighestValue(const size_t index)
+{
+    const uint32_t magnitude = index < 2 * subBucketCount ? 0 : static_cast<uint32_t>(index >> subBucketBits) - 1;
+    const uint64_t lowestValue = static_cast<uint64_t>(index - (static_cast<size_t>(magnitude) << subBucketBits)) << magnitude;
+    return lowestValue + (uint64_t(1) << magnitude) - 1;
+}
+
+void LatencyHistogram::Record(const uint64_t nanoseconds)
+{
+    counts[GetBucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    uint64_t currentMax = max.load(std::memory_order_relaxed);
+    while (nanoseconds > currentMax && !max.compare_exchange_weak(currentMax, nanoseconds, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t LatencyHistogram::GetCount() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetMax() const
+{
+    return max.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::GetMean() const
+{
+    const uint64_t numSamples = GetCount();
+    return numSamples == 0 ? 0.0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / static_cast<double>(numSamples);
+}
+
+uint64_t LatencyHistogram::GetValueAtPercentile(const double percentile) const
+{
+    const uint64_t numSamples = GetCount();
+    if (numSamples == 0)
+    {
+        return 0;
+    }
+
+    const double clampedPercentile = std::clamp(percentile, 0.0, 100.0);
+    const uint64_t targetCount = std::max<uint64_t>(static_cast<uint64_t>(clampedPercentile / 100.0 * static_cast<double>(numSamples) + 0.5), 1);
+
+    uint64_t seenCount = 0;
+    for (size_t i = 0; i < numBuckets; i++)
+    {
+        seenCount += counts[i].load(std::memory_order_relaxed);
+        if (seenCount >= targetCount)
+        {
+            return std::min(GetBucketHighestValue(i), GetMax());
+        }
+    }
+
+    return GetMax();
+}
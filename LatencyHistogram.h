@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Fixed size, lock free histogram of nanosecond samples using HDR style log buckets.
+// Every power of two is split into 32 linear sub-buckets, so any value is reported within about 3% of what was recorded.
+// Recording is a couple of relaxed atomic adds, which is cheap enough to leave on all the time.
+class LatencyHistogram
+{
+public:
+    void Record(uint64_t nanoseconds);
+
+    uint64_t GetCount() const;
+    uint64_t GetMax() const;
+    double GetMean() const;
+
+    // The highest value that percentile (0 - 100) of all samples are at or below.
+    uint64_t GetValueAtPercentile(double percentile) const;
+
+private:
+    static constexpr uint32_t subBucketBits = 5;
+    static constexpr uint32_t subBucketCount = 1 << subBucketBits;
+    static constexpr size_t numBuckets = (64 - subBucketBits + 1) * subBucketCount;
+
+    static size_t GetBucketIndex(uint64_t value);
+    static uint64_t GetBucketHighestValue(size_t index);
+
+    std::array<std::atomic<uint64_t>, numBuckets> counts{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+};
@@ -0,0 +1,374 @@
+#include "PerfCounters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace PerfCounters
+{
+    constexpr size_t numCounters = static_cast<size_t>(Counter::NUM_COUNTERS);
+    constexpr size_t numJobs = static_cast<size_t>(Job::NUM_JOBS);
+
+    using Values = std::array<uint64_t, numCounters>;
+
+    const std::array<const char*, numCounters> counterNames
+    {
+        "cycles",
+        "instructions",
+        "LLC misses",
+        "branch misses",
+        "stalled cycles"
+    };
+
+    const std::array<const char*, numJobs> jobNames
+    {
+        "Randomize",
+        "UpdateMotion",
+        "Collide",
+        "Compact",
+        "HandOff",
+        "Rasterize",
+        "WriteEntities",
+        "SwapBuffers"
+    };
+
+    // What every job's counts are divided by.
+    enum class Loop
+    {
+        ONCE,
+        SIMULATION,
+        RENDER
+    };
+
+    const std::array<Loop, numJobs> jobLoops
+    {
+        Loop::ONCE,
+        Loop::SIMULATION,
+        Loop::SIMULATION,
+        Loop::SIMULATION,
+        Loop::SIMULATION,
+        Loop::SIMULATION,
+        Loop::RENDER,
+        Loop::RENDER
+    };
+
+    const std::array<const char*, 3> loopUnits
+    {
+        "in all",
+        "per frame",
+        "per rendered frame"
+    };
+
+    // Never opened, a counter's place in its thread's group otherwise.
+    constexpr size_t notOpened = numCounters;
+
+    struct ThreadCounters
+    {
+        std::string name;
+        int groupFile = -1;
+        std::array<int, numCounters> files;
+        std::array<size_t, numCounters> groupSlots;
+        size_t numOpened = 0;
+        std::array<Values, numJobs> totals{};
+
+        ThreadCounters()
+        {
+            files.fill(-1);
+            groupSlots.fill(notOpened);
+        }
+
+        ~ThreadCounters()
+        {
+#if defined(__linux__)
+            for (const int file : files)
+            {
+                if (file != -1)
+                {
+                    close(file);
+                }
+            }
+#endif
+        }
+    };
+
+    std::atomic<bool> isEnabled{false};
+    std::string unavailableReason;
+
+    // Owns every thread's counters, so they are still around for the report once the threads are gone.
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadCounters>> threads;
+
+    thread_local ThreadCounters* threadCounters = nullptr;
+    thread_local int threadOpenError = 0;
+    thread_local const char* threadName = "Worker";
+
+#if defined(__linux__)
+    // LLC misses are the generic cache miss event, which is last level cache misses on every CPU perf knows of.
+    constexpr std::array<uint64_t, numCounters> counterConfigs
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_STALLED_CYCLES_BACKEND
+    };
+
+    int OpenCounter(const uint64_t config, const int groupFile)
+    {
+        // Only the calling thread, on whichever CPU it runs, in user space so it works with perf_event_paranoid at its default of 2.
+        // The group leader starts out disabled and the whole group is enabled at once when it is complete.
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.config = config;
+        attributes.disabled = groupFile == -1 ? 1 : 0;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, groupFile, 0));
+    }
+
+    // Counters the CPU doesn't have are left out of the group, only cycles are needed for any of it to be worth counting.
+    bool Open(ThreadCounters& counters)
+    {
+        for (size_t i = 0; i < numCounters; i++)
+        {
+            const int file = OpenCounter(counterConfigs[i], counters.groupFile);
+            if (file == -1)
+            {
+                if (i == static_cast<size_t>(Counter::CYCLES))
+                {
+                    threadOpenError = errno;
+                    return false;
+                }
+
+                continue;
+            }
+
+            if (counters.groupFile == -1)
+            {
+                counters.groupFile = file;
+            }
+            counters.files[i] = file;
+            counters.groupSlots[i] = counters.numOpened++;
+        }
+
+        ioctl(counters.groupFile, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counters.groupFile, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+    }
+
+    bool Read(const ThreadCounters& counters, Values& outValues)
+    {
+        // Number of counters, time enabled and time running, then every counter in the order they were opened.
+        std::array<uint64_t, 3 + numCounters> buffer;
+        const ssize_t expectedSize = static_cast<ssize_t>((3 + counters.numOpened) * sizeof(uint64_t));
+        if (read(counters.groupFile, buffer.data(), sizeof(buffer)) < expectedSize)
+        {
+            return false;
+        }
+
+        // With more counters than the CPU has, groups take turns and every count is scaled up to the whole time it was enabled.
+        const uint64_t timeEnabled = buffer[1];
+        const uint64_t timeRunning = buffer[2];
+        const double scale = timeRunning > 0 && timeRunning < timeEnabled ? static_cast<double>(timeEnabled) / static_cast<double>(timeRunning) : 1.0;
+        for (size_t i = 0; i < numCounters; i++)
+        {
+            outValues[i] = counters.groupSlots[i] == notOpened ? 0 : static_cast<uint64_t>(static_cast<double>(buffer[3 + counters.groupSlots[i]]) * scale);
+        }
+
+        return true;
+    }
+#endif
+
+    // The calling thread's counters, opened the first time it asks. nullptr when they can't be opened, which is only tried once.
+    ThreadCounters* GetThreadCounters()
+    {
+#if defined(__linux__)
+        if (threadCounters != nullptr || threadOpenError != 0)
+        {
+            return threadCounters;
+        }
+
+        std::unique_ptr<ThreadCounters> counters = std::make_unique<ThreadCounters>();
+        if (!Open(*counters))
+        {
+            return nullptr;
+        }
+
+        counters->name = threadName;
+        threadCounters = counters.get();
+
+        std::lock_guard lock(threadsMutex);
+        threads.push_back(std::move(counters));
+        return threadCounters;
+#else
+        return nullptr;
+#endif
+    }
+
+    bool Enable()
+    {
+#if defined(__linux__)
+        // Opening them on the calling thread finds out whether counters can be opened at all.
+        if (GetThreadCounters() == nullptr)
+        {
+            unavailableReason = std::string("perf_event_open failed: ") + std::strerror(threadOpenError);
+            return false;
+        }
+
+        isEnabled.store(true, std::memory_order_relaxed);
+        return true;
+#else
+        unavailableReason = "only counted on Linux";
+        return false;
+#endif
+    }
+
+    bool IsEnabled()
+    {
+        return isEnabled.load(std::memory_order_relaxed);
+    }
+
+    void SetThreadName(const char* name)
+    {
+        threadName = name;
+        if (threadCounters != nullptr)
+        {
+            std::lock_guard lock(threadsMutex);
+            threadCounters->name = name;
+        }
+    }
+
+    Scope::Scope(const Job jobIn) : job(jobIn)
+    {
+#if defined(__linux__)
+        if (!isEnabled.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        const ThreadCounters* counters = GetThreadCounters();
+        isCounting = counters != nullptr && Read(*counters, start);
+#endif
+    }
+
+    Scope::~Scope()
+    {
+#if defined(__linux__)
+        Values end;
+        if (!isCounting || !Read(*threadCounters, end))
+        {
+            return;
+        }
+
+        // Scaled counts can come out a little behind the last read while the CPU multiplexes, those are clamped.
+        Values& total = threadCounters->totals[static_cast<size_t>(job)];
+        for (size_t i = 0; i < numCounters; i++)
+        {
+            total[i] += end[i] > start[i] ? end[i] - start[i] : 0;
+        }
+#endif
+    }
+
+    // Every count per run and per entity, numEntities summed over all the runs.
+    void PrintValues(std::ostream& stream, const Values& values, const std::array<bool, numCounters>& isAvailable, const double numRuns, const double numEntities)
+    {
+        const double cycles = static_cast<double>(values[static_cast<size_t>(Counter::CYCLES)]);
+        const double instructions = static_cast<double>(values[static_cast<size_t>(Counter::INSTRUCTIONS)]);
+        stream << " IPC " << std::fixed << std::setprecision(2) << (cycles > 0.0 ? instructions / cycles : 0.0) << std::defaultfloat;
+
+        for (size_t i = 0; i < numCounters; i++)
+        {
+            if (!isAvailable[i])
+            {
+                stream << ", n/a " << counterNames[i];
+                continue;
+            }
+
+            const double perRun = static_cast<double>(values[i]) / numRuns;
+            stream << ", " << static_cast<uint64_t>(perRun + 0.5) << " " << counterNames[i] << " (" << std::setprecision(3) << static_cast<double>(values[i]) / numEntities << ")";
+        }
+        stream << std::endl;
+    }
+
+    void PrintReport(std::ostream& stream, const Workload& workload)
+    {
+        if (!IsEnabled())
+        {
+            stream << "Hardware counters: not available, " << unavailableReason << std::endl;
+            return;
+        }
+
+        // Threads are done by now, nothing is counting any more.
+        std::lock_guard lock(threadsMutex);
+
+        std::array<bool, numCounters> isAvailable{};
+        std::array<Values, numJobs> jobTotals{};
+        for (const std::unique_ptr<ThreadCounters>& counters : threads)
+        {
+            for (size_t i = 0; i < numCounters; i++)
+            {
+                isAvailable[i] = isAvailable[i] || counters->groupSlots[i] != notOpened;
+            }
+
+            for (size_t job = 0; job < numJobs; job++)
+            {
+                for (size_t i = 0; i < numCounters; i++)
+                {
+                    jobTotals[job][i] += counters->totals[job][i];
+                }
+            }
+        }
+
+        const std::streamsize previousPrecision = stream.precision();
+        const std::array<uint64_t, 3> loopRuns{ 1, workload.numFrames, workload.numRenderedFrames };
+        const std::array<uint64_t, 3> loopEntities{ workload.numRandomizedEntities, workload.numLiveEntities, workload.numRenderedEntities };
+
+        stream << "Hardware counters (per entity):" << std::endl;
+        for (size_t job = 0; job < numJobs; job++)
+        {
+            const size_t loop = static_cast<size_t>(jobLoops[job]);
+            if (loopRuns[loop] == 0 || loopEntities[loop] == 0 || jobTotals[job][static_cast<size_t>(Counter::CYCLES)] == 0)
+            {
+                continue;
+            }
+
+            stream << "  " << jobNames[job] << " " << loopUnits[loop] << ":";
+            PrintValues(stream, jobTotals[job], isAvailable, static_cast<double>(loopRuns[loop]), static_cast<double>(loopEntities[loop]));
+        }
+
+        // Per thread over every job it ran, per simulated frame so workers and the render loop add up to the frame's total.
+        const double numFramesDouble = static_cast<double>(std::max<uint64_t>(workload.numFrames, 1));
+        const double numLiveEntitiesDouble = static_cast<double>(std::max<uint64_t>(workload.numLiveEntities, 1));
+        for (size_t thread = 0; thread < threads.size(); thread++)
+        {
+            Values threadTotal{};
+            for (const Values& values : threads[thread]->totals)
+            {
+                for (size_t i = 0; i < numCounters; i++)
+                {
+                    threadTotal[i] += values[i];
+                }
+            }
+
+            stream << "  Thread " << thread << " (" << threads[thread]->name << ") per frame:";
+            PrintValues(stream, threadTotal, isAvailable, numFramesDouble, numLiveEntitiesDouble);
+        }
+
+        stream.precision(previousPrecision);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Hardware counters per job and per thread, to tell whether a job is bound by compute or by memory. Linux only, through perf_event_open.
+// Every thread opens a group of counters of its own the first time it measures anything, and adds what they counted during a scope to the job the scope is for.
+// Scopes are only put around work that doesn't start other work, so a thread helping out with queued jobs while it waits is never counted twice.
+// Where counters can't be opened, on other platforms, in containers or with perf_event_paranoid set too high, nothing is counted and the report says why.
+namespace PerfCounters
+{
+    enum class Counter
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        LLC_MISSES,
+        BRANCH_MISSES,
+        STALLED_CYCLES, // Backend stalls, cycles spent waiting on memory or busy execution units. Not every CPU counts them.
+
+        NUM_COUNTERS
+    };
+
+    enum class Job
+    {
+        RANDOMIZE,
+        UPDATE_MOTION,
+        COLLIDE,
+        COMPACT,
+        HAND_OFF,
+        RASTERIZE,
+        WRITE_ENTITIES,
+        SWAP_BUFFERS,
+
+        NUM_JOBS
+    };
+
+    // Counting is off until enabled, a scope is then a single branch. Returns false when the calling thread can't open counters, they stay off then.
+    bool Enable();
+    bool IsEnabled();
+
+    // Threads show up in the report by name, in the order they first measured something. Threads that don't set one are named after the job system's workers.
+    void SetThreadName(const char* name);
+
+    // Counts what the calling thread does while it is alive towards job.
+    class Scope
+    {
+    public:
+        explicit Scope(Job job);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Job job;
+        bool isCounting = false;
+        std::array<uint64_t, static_cast<size_t>(Counter::NUM_COUNTERS)> start{};
+    };
+
+    // What the counts are divided by. The number of entities changes as they are spawned and despawned, so they are summed over the frames.
+    struct Workload
+    {
+        uint64_t numFrames = 0;
+        uint64_t numLiveEntities = 0; // Summed over every simulated frame.
+        uint64_t numRenderedFrames = 0;
+        uint64_t numRenderedEntities = 0; // Summed over every rendered frame.
+        uint64_t numRandomizedEntities = 0; // Randomize only runs once, at startup.
+    };
+
+    // Every job's counts per run of the loop it runs in and per entity in that run, then every thread's per simulated frame and live entity.
+    // Render jobs run once per rendered frame, Randomize once in all and the rest once per simulated frame.
+    void PrintReport(std::ostream& stream, const Workload& workload);
+}
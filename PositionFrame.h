@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Entity.h"
+#include "SpatialBins.h"
+
+// Everything the simulation writes each frame for the renderer to read, handed over together through the triple buffer.
+struct PositionFrame
+{
+    Entity::Positions positions;
+    SpatialBins bins;
+};
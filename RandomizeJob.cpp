@@ -1,65 +1,378 @@
 #include "RandomizeJob.h"
 
-#include <thread>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
 #include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) // x64
+#include <immintrin.h>
+#elif defined(__arm__) || defined(__aarch64__) // ARM
+#include <arm_neon.h>
+#endif
+
+#include "JobSystem.h"
+#include "PerfCounters.h"
+#include "Trace.h"
 
 namespace RandomizeJob
 {
-    std::mt19937 GetRandomGenerator()
+    // Philox4x32-10 from "Parallel Random Numbers: As Easy as 1, 2, 3" (Salmon et al.), turns a 128 bit counter and a 64 bit key into four random words.
+    constexpr uint32_t philoxMultiplier0 = 0xD2511F53;
+    constexpr uint32_t philoxMultiplier1 = 0xCD9E8D57;
+    constexpr uint32_t philoxWeyl0 = 0x9E3779B9;
+    constexpr uint32_t philoxWeyl1 = 0xBB67AE85;
+    constexpr size_t philoxRounds = 10;
+
+    // Entities are generated 32 at a time, in several SIMD registers. Every round depends on the one before it, so working on a few registers at once keeps the multipliers busy.
+    constexpr size_t lanes = 32;
+
+    // Every component draws from its own stream, so they don't depend on each other.
+    enum class Stream : uint32_t
+    {
+        POSITIONS,
+        VELOCITIES,
+        PHYSICS
+    };
+
+    struct RandomWords
+    {
+        std::array<uint32_t, lanes> first;
+        std::array<uint32_t, lanes> second;
+        std::array<uint32_t, lanes> third;
+        std::array<uint32_t, lanes> fourth;
+    };
+
+    // Runs the rounds on every lane's counter in place, leaving the random words in their place. The key is the seed.
+    using PhiloxFunction = void (*)(uint64_t seed, RandomWords& inOutWords);
+
+    void SetCounters(const Stream stream, const size_t firstEntity, RandomWords& outWords)
+    {
+        for (size_t lane = 0; lane < lanes; lane++)
+        {
+            const uint64_t entity = firstEntity + lane;
+            outWords.first[lane] = static_cast<uint32_t>(entity);
+            outWords.second[lane] = static_cast<uint32_t>(entity >> 32);
+            outWords.third[lane] = static_cast<uint32_t>(stream);
+            outWords.fourth[lane] = 0;
+        }
+    }
+
+    void PhiloxScalar(const uint64_t seed, RandomWords& outWords)
+    {
+        uint32_t key0 = static_cast<uint32_t>(seed);
+        uint32_t key1 = static_cast<uint32_t>(seed >> 32);
+        for (size_t round = 0; round < philoxRounds; round++)
+        {
+            for (size_t lane = 0; lane < lanes; lane++)
+            {
+                const uint64_t product0 = static_cast<uint64_t>(philoxMultiplier0) * outWords.first[lane];
+                const uint64_t product1 = static_cast<uint64_t>(philoxMultiplier1) * outWords.third[lane];
+                outWords.first[lane] = static_cast<uint32_t>(product1 >> 32) ^ outWords.second[lane] ^ key0;
+                outWords.second[lane] = static_cast<uint32_t>(product1);
+                outWords.third[lane] = static_cast<uint32_t>(product0 >> 32) ^ outWords.fourth[lane] ^ key1;
+                outWords.fourth[lane] = static_cast<uint32_t>(product0);
+            }
+
+            key0 += philoxWeyl0;
+            key1 += philoxWeyl1;
+        }
+    }
+
+#if defined(__x86_64__) || defined(_M_X64) // x64
+    // Only every other lane can be multiplied into 64 bits, so the even and odd lanes are multiplied separately and their halves interleaved back together.
+    // That costs as much as it saves with four lanes, so there's no SSE version and anything without AVX2 uses the scalar one.
+    __attribute__((target("avx2")))
+    inline void MultiplyEightLane(const __m256i values, const uint32_t multiplier, __m256i& outHigh, __m256i& outLow)
+    {
+        const __m256i multiplierEightLane = _mm256_set1_epi32(static_cast<int32_t>(multiplier));
+        const __m256i evenProducts = _mm256_mul_epu32(values, multiplierEightLane);
+        const __m256i oddProducts = _mm256_mul_epu32(_mm256_srli_epi64(values, 32), multiplierEightLane);
+        outLow = _mm256_unpacklo_epi32(_mm256_shuffle_epi32(evenProducts, _MM_SHUFFLE(0, 0, 2, 0)), _mm256_shuffle_epi32(oddProducts, _MM_SHUFFLE(0, 0, 2, 0)));
+        outHigh = _mm256_unpacklo_epi32(_mm256_shuffle_epi32(evenProducts, _MM_SHUFFLE(0, 0, 3, 1)), _mm256_shuffle_epi32(oddProducts, _MM_SHUFFLE(0, 0, 3, 1)));
+    }
+
+    __attribute__((target("avx2")))
+    void PhiloxAvx2(const uint64_t seed, RandomWords& outWords)
+    {
+        constexpr size_t lanesPerRegister = 8;
+        constexpr size_t numRegisters = lanes / lanesPerRegister;
+
+        __m256i first[numRegisters];
+        __m256i second[numRegisters];
+        __m256i third[numRegisters];
+        __m256i fourth[numRegisters];
+        for (size_t i = 0; i < numRegisters; i++)
+        {
+            first[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&outWords.first[i * lanesPerRegister]));
+            second[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&outWords.second[i * lanesPerRegister]));
+            third[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&outWords.third[i * lanesPerRegister]));
+            fourth[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&outWords.fourth[i * lanesPerRegister]));
+        }
+
+        uint32_t key0 = static_cast<uint32_t>(seed);
+        uint32_t key1 = static_cast<uint32_t>(seed >> 32);
+        for (size_t round = 0; round < philoxRounds; round++)
+        {
+            const __m256i key0EightLane = _mm256_set1_epi32(static_cast<int32_t>(key0));
+            const __m256i key1EightLane = _mm256_set1_epi32(static_cast<int32_t>(key1));
+            for (size_t i = 0; i < numRegisters; i++)
+            {
+                __m256i high0;
+                __m256i low0;
+                __m256i high1;
+                __m256i low1;
+                MultiplyEightLane(first[i], philoxMultiplier0, high0, low0);
+                MultiplyEightLane(third[i], philoxMultiplier1, high1, low1);
+                first[i] = _mm256_xor_si256(_mm256_xor_si256(high1, second[i]), key0EightLane);
+                second[i] = low1;
+                third[i] = _mm256_xor_si256(_mm256_xor_si256(high0, fourth[i]), key1EightLane);
+                fourth[i] = low0;
+            }
+
+            key0 += philoxWeyl0;
+            key1 += philoxWeyl1;
+        }
+
+        for (size_t i = 0; i < numRegisters; i++)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&outWords.first[i * lanesPerRegister]), first[i]);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&outWords.second[i * lanesPerRegister]), second[i]);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&outWords.third[i * lanesPerRegister]), third[i]);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&outWords.fourth[i * lanesPerRegister]), fourth[i]);
+        }
+    }
+#elif defined(__arm__) || defined(__aarch64__) // ARM
+    inline void MultiplyFourLane(const uint32x4_t values, const uint32_t multiplier, uint32x4_t& outHigh, uint32x4_t& outLow)
+    {
+        const uint64x2_t lowProducts = vmull_n_u32(vget_low_u32(values), multiplier);
+        const uint64x2_t highProducts = vmull_n_u32(vget_high_u32(values), multiplier);
+        outLow = vcombine_u32(vmovn_u64(lowProducts), vmovn_u64(highProducts));
+        outHigh = vcombine_u32(vshrn_n_u64(lowProducts, 32), vshrn_n_u64(highProducts, 32));
+    }
+
+    void PhiloxNeon(const uint64_t seed, RandomWords& outWords)
+    {
+        constexpr size_t lanesPerRegister = 4;
+        constexpr size_t numRegisters = lanes / lanesPerRegister;
+
+        uint32x4_t first[numRegisters];
+        uint32x4_t second[numRegisters];
+        uint32x4_t third[numRegisters];
+        uint32x4_t fourth[numRegisters];
+        for (size_t i = 0; i < numRegisters; i++)
+        {
+            first[i] = vld1q_u32(&outWords.first[i * lanesPerRegister]);
+            second[i] = vld1q_u32(&outWords.second[i * lanesPerRegister]);
+            third[i] = vld1q_u32(&outWords.third[i * lanesPerRegister]);
+            fourth[i] = vld1q_u32(&outWords.fourth[i * lanesPerRegister]);
+        }
+
+        uint32_t key0 = static_cast<uint32_t>(seed);
+        uint32_t key1 = static_cast<uint32_t>(seed >> 32);
+        for (size_t round = 0; round < philoxRounds; round++)
+        {
+            for (size_t i = 0; i < numRegisters; i++)
+            {
+                uint32x4_t high0;
+                uint32x4_t low0;
+                uint32x4_t high1;
+                uint32x4_t low1;
+                MultiplyFourLane(first[i], philoxMultiplier0, high0, low0);
+                MultiplyFourLane(third[i], philoxMultiplier1, high1, low1);
+                first[i] = veorq_u32(veorq_u32(high1, second[i]), vdupq_n_u32(key0));
+                second[i] = low1;
+                third[i] = veorq_u32(veorq_u32(high0, fourth[i]), vdupq_n_u32(key1));
+                fourth[i] = low0;
+            }
+
+            key0 += philoxWeyl0;
+            key1 += philoxWeyl1;
+        }
+
+        for (size_t i = 0; i < numRegisters; i++)
+        {
+            vst1q_u32(&outWords.first[i * lanesPerRegister], first[i]);
+            vst1q_u32(&outWords.second[i * lanesPerRegister], second[i]);
+            vst1q_u32(&outWords.third[i * lanesPerRegister], third[i]);
+            vst1q_u32(&outWords.fourth[i * lanesPerRegister], fourth[i]);
+        }
+    }
+#endif
+
+    struct PhiloxVersion
+    {
+        const char* name;
+        PhiloxFunction function;
+    };
+
+    // Every version the CPU can run, fastest last. They all compute exactly the same words.
+    std::vector<PhiloxVersion> GetPhiloxVersions()
+    {
+        std::vector<PhiloxVersion> versions{ { "scalar", &PhiloxScalar } };
+#if defined(__x86_64__) || defined(_M_X64) // x64
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            versions.push_back({ "avx2", &PhiloxAvx2 });
+        }
+#elif defined(__arm__) || defined(__aarch64__) // ARM
+        versions.push_back({ "neon", &PhiloxNeon });
+#endif
+        return versions;
+    }
+
+    const PhiloxFunction philox = GetPhiloxVersions().back().function;
+
+    void GenerateWords(const uint64_t seed, const Stream stream, const size_t firstEntity, RandomWords& outWords)
+    {
+        SetCounters(stream, firstEntity, outWords);
+        philox(seed, outWords);
+    }
+
+    // The known answers Random123 ships for Philox4x32-10, as counter, key and the four words they give.
+    struct KnownAnswer
+    {
+        std::array<uint32_t, 4> counter;
+        uint64_t key;
+        std::array<uint32_t, 4> words;
+    };
+
+    constexpr std::array<KnownAnswer, 3> knownAnswers
+    {{
+        { { 0x00000000, 0x00000000, 0x00000000, 0x00000000 }, 0x0000000000000000, { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 } },
+        { { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff }, 0xffffffffffffffff, { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd } },
+        { { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }, 0x299f31d0a4093822, { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 } }
+    }};
+
+    bool CheckKnownAnswers()
+    {
+        bool isCorrect = true;
+        for (const PhiloxVersion& version : GetPhiloxVersions())
+        {
+            for (const KnownAnswer& answer : knownAnswers)
+            {
+                // Every lane gets the same counter, so every lane of every register has to come out the same.
+                RandomWords words;
+                words.first.fill(answer.counter[0]);
+                words.second.fill(answer.counter[1]);
+                words.third.fill(answer.counter[2]);
+                words.fourth.fill(answer.counter[3]);
+                version.function(answer.key, words);
+
+                for (size_t lane = 0; lane < lanes; lane++)
+                {
+                    const std::array<uint32_t, 4> laneWords{ words.first[lane], words.second[lane], words.third[lane], words.fourth[lane] };
+                    if (laneWords != answer.words)
+                    {
+                        std::cerr << "The " << version.name << " Philox4x32-10 gives the wrong words in lane " << lane << " for counter "
+                            << std::hex << answer.counter[0] << " " << answer.counter[1] << " " << answer.counter[2] << " " << answer.counter[3] << std::dec << std::endl;
+                        isCorrect = false;
+                        break;
+                    }
+                }
+            }
+        }
+
+        return isCorrect;
+    }
+
+    // The top 24 bits as a float in [min, max), exact steps of 2^-24 so the conversion is the same everywhere.
+    inline float ToRange(const uint32_t word, const float min, const float max)
+    {
+        return min + static_cast<float>(word >> 8) * (1.0f / 16777216.0f) * (max - min);
+    }
+
+    uint64_t GenerateSeed()
     {
         std::random_device randomDevice;
-        return std::mt19937(randomDevice());
+        return (static_cast<uint64_t>(randomDevice()) << 32) | randomDevice();
     }
-    
-    void RandomizePositions(std::array<Entity::Position, Entity::numEntities>& positions)
+
+    void RandomizePositions(Entity::Positions& positions, const uint64_t seed, const size_t begin, const size_t end)
     {
-        std::mt19937 generator = GetRandomGenerator();
-        std::uniform_real_distribution range(-10.0f, 10.0f);
-    
-        for (auto& [pos] : positions)
+        for (size_t i = begin; i < end; i += lanes)
         {
-            pos.x = range(generator);
-            pos.y = range(generator);       
+            RandomWords words;
+            GenerateWords(seed, Stream::POSITIONS, i, words);
+            const size_t numLanes = std::min(lanes, end - i);
+            for (size_t lane = 0; lane < numLanes; lane++)
+            {
+                positions.x[i + lane] = ToRange(words.first[lane], -10.0f, 10.0f);
+                positions.y[i + lane] = ToRange(words.second[lane], -10.0f, 10.0f);
+            }
         }
     }
 
-    void RandomizeVelocities(std::array<Entity::Velocity, Entity::numEntities>& velocities)
+    void RandomizeVelocities(Entity::Velocities& velocities, const uint64_t seed, const size_t begin, const size_t end)
     {
-        std::mt19937 generator = GetRandomGenerator();
-        std::uniform_real_distribution speedRange(0.0f, 20.0f);
-        std::uniform_real_distribution directionRange(-1.0f, 1.0f);
-    
-        for (auto& [speed, direction] : velocities)
+        for (size_t i = begin; i < end; i += lanes)
         {
-            speed = speedRange(generator);
-            
-            const float randomDirX = directionRange(generator);       
-            const float randomDirY = directionRange(generator);
-            const float magnitude = std::sqrt(randomDirX * randomDirX + randomDirY * randomDirY);
-            direction.x = randomDirX / magnitude;
-            direction.y = randomDirY / magnitude;
+            RandomWords words;
+            GenerateWords(seed, Stream::VELOCITIES, i, words);
+            const size_t numLanes = std::min(lanes, end - i);
+            for (size_t lane = 0; lane < numLanes; lane++)
+            {
+                velocities.speed[i + lane] = ToRange(words.first[lane], 0.0f, 20.0f);
+
+                const float randomDirX = ToRange(words.second[lane], -1.0f, 1.0f);
+                const float randomDirY = ToRange(words.third[lane], -1.0f, 1.0f);
+                const float magnitude = std::sqrt(randomDirX * randomDirX + randomDirY * randomDirY);
+                velocities.directionX[i + lane] = randomDirX / magnitude;
+                velocities.directionY[i + lane] = randomDirY / magnitude;
+            }
         }
     }
 
-    void RandomizePhysics(std::array<Entity::Physics, Entity::numEntities>& physics)
+    void RandomizePhysics(Entity::Physics& physics, const uint64_t seed, const size_t begin, const size_t end)
     {
-        std::mt19937 generator = GetRandomGenerator();
-        std::uniform_real_distribution accelerationRange(-3.0f, 3.0f);
-    
-        for (auto& [acceleration] : physics)
+        for (size_t i = begin; i < end; i += lanes)
         {
-            acceleration = accelerationRange(generator);
+            RandomWords words;
+            GenerateWords(seed, Stream::PHYSICS, i, words);
+            const size_t numLanes = std::min(lanes, end - i);
+            for (size_t lane = 0; lane < numLanes; lane++)
+            {
+                physics.acceleration[i + lane] = ToRange(words.first[lane], -3.0f, 3.0f);
+            }
         }
     }
 
-    void Run(std::array<Entity::Position, Entity::numEntities>& positions, std::array<Entity::Velocity, Entity::numEntities>& velocities, std::array<Entity::Physics, Entity::numEntities>& physics)
+    Entity::State GenerateEntity(const uint64_t seed, const size_t counter)
+    {
+        // The generator always fills a whole batch of lanes, only the first one is kept. Same ranges as the Randomize functions.
+        RandomWords positionWords;
+        RandomWords velocityWords;
+        RandomWords physicsWords;
+        GenerateWords(seed, Stream::POSITIONS, counter, positionWords);
+        GenerateWords(seed, Stream::VELOCITIES, counter, velocityWords);
+        GenerateWords(seed, Stream::PHYSICS, counter, physicsWords);
+
+        const float randomDirX = ToRange(velocityWords.second[0], -1.0f, 1.0f);
+        const float randomDirY = ToRange(velocityWords.third[0], -1.0f, 1.0f);
+        const float magnitude = std::sqrt(randomDirX * randomDirX + randomDirY * randomDirY);
+
+        Entity::State state;
+        state.x = ToRange(positionWords.first[0], -10.0f, 10.0f);
+        state.y = ToRange(positionWords.second[0], -10.0f, 10.0f);
+        state.speed = ToRange(velocityWords.first[0], 0.0f, 20.0f);
+        state.directionX = randomDirX / magnitude;
+        state.directionY = randomDirY / magnitude;
+        state.acceleration = ToRange(physicsWords.first[0], -3.0f, 3.0f);
+        return state;
+    }
+
+    void Run(Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, const uint64_t seed)
     {
-        std::thread positionsThread = std::thread(&RandomizePositions, std::ref(positions));
-        std::thread velocitiesThread = std::thread(&RandomizeVelocities, std::ref(velocities));
-        std::thread physicsThread = std::thread(&RandomizePhysics, std::ref(physics));
-    
-        positionsThread.join();
-        velocitiesThread.join();
-        physicsThread.join();
+        JobSystem::ParallelFor(positions.x.size(), grainSize, [&positions, &velocities, &physics, seed](const size_t begin, const size_t end)
+        {
+            const PerfCounters::Scope scope(PerfCounters::Job::RANDOMIZE);
+            const Trace::Span span("Randomize");
+            RandomizePositions(positions, seed, begin, end);
+            RandomizeVelocities(velocities, seed, begin, end);
+            RandomizePhysics(physics, seed, begin, end);
+        });
     }
 }
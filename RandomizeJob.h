@@ -1,10 +1,29 @@
 #pragma once
 
-#include <array>
+#include <cstdint>
 
 #include "Entity.h"
 
 namespace RandomizeJob
 {
-    void Run(std::array<Entity::Position, Entity::numEntities>& positions, std::array<Entity::Velocity, Entity::numEntities>& velocities, std::array<Entity::Physics, Entity::numEntities>& physics);
-}
\ No newline at end of file
+    // Entities per chunk when the work is split across cores.
+    constexpr size_t grainSize = 16384;
+
+    // A seed from the system's random device, for when none is given.
+    uint64_t GenerateSeed();
+
+    // Every value comes from a counter based generator keyed by the seed and counting entity indices, so any entity can be generated on its own.
+    // The same seed always gives the same world, no matter how the entities are split across threads.
+    void RandomizePositions(Entity::Positions& positions, uint64_t seed, size_t begin, size_t end);
+    void RandomizeVelocities(Entity::Velocities& velocities, uint64_t seed, size_t begin, size_t end);
+    void RandomizePhysics(Entity::Physics& physics, uint64_t seed, size_t begin, size_t end);
+
+    // One entity drawn the same way, for entities spawned after the world was randomized. Counters at or past the initial entity count never repeat one of them.
+    Entity::State GenerateEntity(uint64_t seed, size_t counter);
+
+    // Runs every version of the generator the CPU has against the generator's published known answers, in every lane. Reports any that don't match on std::cerr.
+    bool CheckKnownAnswers();
+
+    // Splits all entities across the job system, it has to be initialized.
+    void Run(Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, uint64_t seed);
+}
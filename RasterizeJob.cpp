@@ -0,0 +1,380 @@
+#include "RasterizeJob.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+#if defined(__x86_64__) || defined(_M_X64) // x64
+#include <emmintrin.h>
+#elif defined(__aarch64__) // ARM
+#include <arm_neon.h>
+#endif
+
+#include "JobSystem.h"
+#include "PerfCounters.h"
+#include "RenderJob.h"
+
+// Entities per projection job, a few cache lines of every stream.
+constexpr size_t projectGrainSize = 8192;
+
+// Counts above this share the brightest intensities, the ramp is only worked out this far.
+constexpr uint32_t maxRampCount = 65535;
+
+constexpr size_t frameIndexDigits = 8;
+
+RasterizeJob::RasterizeJob(Arena& arena, const size_t numEntities, const size_t widthIn, const size_t heightIn)
+    : width(widthIn), height(heightIn), numTiles(JobSystem::GetNumWorkers() + 1)
+{
+    // Fit what the console shows into the image without stretching it, centered on the axis that has room to spare.
+    const SpatialBins::Bounds bounds = RenderJob::GetVisibleWorldBounds();
+    const float boundsWidth = bounds.maxX - bounds.minX;
+    const float boundsHeight = bounds.maxY - bounds.minY;
+    scale = std::min(static_cast<float>(width) / boundsWidth, static_cast<float>(height) / boundsHeight);
+    offsetX = (static_cast<float>(width) - boundsWidth * scale) * 0.5f - bounds.minX * scale;
+    offsetY = (static_cast<float>(height) - boundsHeight * scale) * 0.5f + bounds.maxY * scale;
+
+    pixelIndices = Entity::AllocateStream<uint32_t>(arena, numEntities);
+    tilePixels = Entity::AllocateStream<uint32_t>(arena, numEntities);
+    counts.resize(width * height);
+    tileMaxCounts.resize(numTiles);
+    chunkTileOffsets.resize((numEntities + projectGrainSize - 1) / projectGrainSize * numTiles);
+    tileOffsets.resize(numTiles + 1);
+
+    rowTiles.resize(height);
+    for (size_t tile = 0; tile < numTiles; tile++)
+    {
+        std::fill(rowTiles.begin() + static_cast<ptrdiff_t>(GetTileBegin(tile) / width), rowTiles.begin() + static_cast<ptrdiff_t>(GetTileBegin(tile + 1) / width), static_cast<uint32_t>(tile));
+    }
+
+    for (size_t i = 0; i < heatColors.size(); i++)
+    {
+        const float t = static_cast<float>(i) / 255.0f * 3.0f;
+        heatColors[i] = { static_cast<uint8_t>(std::clamp(t, 0.0f, 1.0f) * 255.0f), static_cast<uint8_t>(std::clamp(t - 1.0f, 0.0f, 1.0f) * 255.0f), static_cast<uint8_t>(std::clamp(t - 2.0f, 0.0f, 1.0f) * 255.0f) };
+    }
+}
+
+size_t RasterizeJob::GetArenaBytes(const size_t numEntities)
+{
+    return 2 * Entity::GetStreamBytes<uint32_t>(numEntities);
+}
+
+RasterizeJob::~RasterizeJob()
+{
+    Stop();
+}
+
+bool RasterizeJob::Start(const std::string& path)
+{
+    const bool isGray = path.ends_with(".pgm");
+    isColor = path.ends_with(".ppm");
+    if (!isGray && !isColor)
+    {
+        std::cerr << "Images can only be written as .pgm or .ppm: " << path << std::endl;
+        return false;
+    }
+
+    pathStem = path.substr(0, path.size() - 4);
+    pathExtension = path.substr(path.size() - 4);
+
+    const size_t numChannels = isColor ? 3 : 1;
+    for (Slot& slot : slots)
+    {
+        slot.pixels.resize(width * height * numChannels);
+    }
+
+    writer = std::thread(&RasterizeJob::WriterLoop, this);
+    return true;
+}
+
+void RasterizeJob::Stop()
+{
+    if (!writer.joinable())
+    {
+        return;
+    }
+
+    head.store(head.load(std::memory_order_relaxed) | stoppedFlag, std::memory_order_release);
+    head.notify_one();
+    writer.join();
+}
+
+void RasterizeJob::Run(const Entity::Positions& positions, const uint64_t frameIndex)
+{
+    const uint64_t slotIndex = head.load(std::memory_order_relaxed);
+    if (!writer.joinable() || slotIndex - tail.load(std::memory_order_acquire) >= numSlots)
+    {
+        numDropped++;
+        return;
+    }
+
+    // Chunks start at multiples of the grain size, so every chunk knows its place in chunkTileOffsets.
+    const size_t numEntities = positions.x.size();
+    JobSystem::ParallelFor(numEntities, projectGrainSize, [this, &positions](const size_t begin, const size_t end)
+    {
+        const PerfCounters::Scope scope(PerfCounters::Job::RASTERIZE);
+        Project(positions, begin, end);
+        CountTiles(begin / projectGrainSize, begin, end);
+    });
+
+    // Every tile's pixels in chunk order, which is only a few numbers per chunk.
+    const size_t numChunks = (numEntities + projectGrainSize - 1) / projectGrainSize;
+    uint32_t offset = 0;
+    for (size_t tile = 0; tile < numTiles; tile++)
+    {
+        tileOffsets[tile] = offset;
+        for (size_t chunk = 0; chunk < numChunks; chunk++)
+        {
+            const uint32_t count = chunkTileOffsets[chunk * numTiles + tile];
+            chunkTileOffsets[chunk * numTiles + tile] = offset;
+            offset += count;
+        }
+    }
+    tileOffsets[numTiles] = offset;
+
+    JobSystem::ParallelFor(numEntities, projectGrainSize, [this](const size_t begin, const size_t end)
+    {
+        const PerfCounters::Scope scope(PerfCounters::Job::RASTERIZE);
+        GroupByTile(begin / projectGrainSize, begin, end);
+    });
+
+    JobSystem::ParallelFor(numTiles, 1, [this](const size_t beginTile, const size_t endTile)
+    {
+        const PerfCounters::Scope scope(PerfCounters::Job::RASTERIZE);
+        for (size_t tile = beginTile; tile < endTile; tile++)
+        {
+            Accumulate(tile);
+        }
+    });
+
+    UpdateIntensities(*std::max_element(tileMaxCounts.begin(), tileMaxCounts.end()));
+
+    Slot& slot = slots[slotIndex % numSlots];
+    slot.frameIndex = frameIndex;
+    JobSystem::ParallelFor(numTiles, 1, [this, &slot](const size_t beginTile, const size_t endTile)
+    {
+        const PerfCounters::Scope scope(PerfCounters::Job::RASTERIZE);
+        for (size_t tile = beginTile; tile < endTile; tile++)
+        {
+            WriteTile(slot, tile);
+        }
+    });
+
+    head.store(slotIndex + 1, std::memory_order_release);
+    head.notify_one();
+}
+
+uint64_t RasterizeJob::GetNumWritten() const
+{
+    return numWritten;
+}
+
+uint64_t RasterizeJob::GetNumDropped() const
+{
+    return numDropped;
+}
+
+uint64_t RasterizeJob::GetNumBytesWritten() const
+{
+    return numBytesWritten;
+}
+
+void RasterizeJob::Project(const Entity::Positions& positions, size_t begin, const size_t end)
+{
+    // Row and column are truncated before they are combined, so every lane and the scalar tail land on the same pixel.
+    const float widthFloat = static_cast<float>(width);
+    const float heightFloat = static_cast<float>(height);
+
+#if defined(__x86_64__) || defined(_M_X64) // x64
+    for (; begin + 4 <= end; begin += 4)
+    {
+        const __m128 column = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&positions.x[begin]), _mm_set1_ps(scale)), _mm_set1_ps(offsetX));
+        const __m128 row = _mm_sub_ps(_mm_set1_ps(offsetY), _mm_mul_ps(_mm_loadu_ps(&positions.y[begin]), _mm_set1_ps(scale)));
+        const __m128 isInsideX = _mm_and_ps(_mm_cmpge_ps(column, _mm_setzero_ps()), _mm_cmplt_ps(column, _mm_set1_ps(widthFloat)));
+        const __m128 isInsideY = _mm_and_ps(_mm_cmpge_ps(row, _mm_setzero_ps()), _mm_cmplt_ps(row, _mm_set1_ps(heightFloat)));
+        const __m128i isInside = _mm_castps_si128(_mm_and_ps(isInsideX, isInsideY));
+
+        const __m128 wholeColumn = _mm_cvtepi32_ps(_mm_cvttps_epi32(column));
+        const __m128 wholeRow = _mm_cvtepi32_ps(_mm_cvttps_epi32(row));
+        const __m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(wholeRow, _mm_set1_ps(widthFloat)), wholeColumn));
+
+        // Lanes outside the image are all ones, which is outsideImage.
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&pixelIndices[begin]), _mm_or_si128(_mm_and_si128(isInside, index), _mm_xor_si128(isInside, _mm_set1_epi32(-1))));
+    }
+#elif defined(__aarch64__) // ARM
+    for (; begin + 4 <= end; begin += 4)
+    {
+        const float32x4_t column = vaddq_f32(vmulq_f32(vld1q_f32(&positions.x[begin]), vdupq_n_f32(scale)), vdupq_n_f32(offsetX));
+        const float32x4_t row = vsubq_f32(vdupq_n_f32(offsetY), vmulq_f32(vld1q_f32(&positions.y[begin]), vdupq_n_f32(scale)));
+        const uint32x4_t isInsideX = vandq_u32(vcgeq_f32(column, vdupq_n_f32(0.0f)), vcltq_f32(column, vdupq_n_f32(widthFloat)));
+        const uint32x4_t isInsideY = vandq_u32(vcgeq_f32(row, vdupq_n_f32(0.0f)), vcltq_f32(row, vdupq_n_f32(heightFloat)));
+        const uint32x4_t isInside = vandq_u32(isInsideX, isInsideY);
+
+        const float32x4_t wholeColumn = vcvtq_f32_s32(vcvtq_s32_f32(column));
+        const float32x4_t wholeRow = vcvtq_f32_s32(vcvtq_s32_f32(row));
+        const uint32x4_t index = vreinterpretq_u32_s32(vcvtq_s32_f32(vaddq_f32(vmulq_f32(wholeRow, vdupq_n_f32(widthFloat)), wholeColumn)));
+
+        vst1q_u32(&pixelIndices[begin], vorrq_u32(vandq_u32(isInside, index), vmvnq_u32(isInside)));
+    }
+#endif
+
+    for (; begin < end; begin++)
+    {
+        const float column = positions.x[begin] * scale + offsetX;
+        const float row = offsetY - positions.y[begin] * scale;
+        if (!(column >= 0.0f && column < widthFloat && row >= 0.0f && row < heightFloat))
+        {
+            pixelIndices[begin] = outsideImage;
+            continue;
+        }
+
+        const float wholeColumn = static_cast<float>(static_cast<int32_t>(column));
+        const float wholeRow = static_cast<float>(static_cast<int32_t>(row));
+        pixelIndices[begin] = static_cast<uint32_t>(wholeRow * widthFloat + wholeColumn);
+    }
+}
+
+size_t RasterizeJob::GetTileBegin(const size_t tile) const
+{
+    // Whole rows, so every tile is one contiguous range of pixels.
+    return tile * height / numTiles * width;
+}
+
+void RasterizeJob::CountTiles(const size_t chunk, const size_t begin, const size_t end)
+{
+    uint32_t* tileCounts = chunkTileOffsets.data() + chunk * numTiles;
+    std::fill(tileCounts, tileCounts + numTiles, 0);
+
+    const uint32_t widthU32 = static_cast<uint32_t>(width);
+    for (size_t i = begin; i < end; i++)
+    {
+        const uint32_t pixel = pixelIndices[i];
+        if (pixel != outsideImage)
+        {
+            tileCounts[rowTiles[pixel / widthU32]]++;
+        }
+    }
+}
+
+void RasterizeJob::GroupByTile(const size_t chunk, const size_t begin, const size_t end)
+{
+    // Every chunk writes to ranges of its own, the offsets are its cursors from here on.
+    uint32_t* cursors = chunkTileOffsets.data() + chunk * numTiles;
+    const uint32_t widthU32 = static_cast<uint32_t>(width);
+    for (size_t i = begin; i < end; i++)
+    {
+        const uint32_t pixel = pixelIndices[i];
+        if (pixel != outsideImage)
+        {
+            tilePixels[cursors[rowTiles[pixel / widthU32]]++] = pixel;
+        }
+    }
+}
+
+void RasterizeJob::Accumulate(const size_t tile)
+{
+    // Only the entities in the tile are walked, and only the tile's own pixels are touched.
+    const size_t tileBegin = GetTileBegin(tile);
+    uint32_t* tileCounts = counts.data() + tileBegin;
+    std::fill(tileCounts, counts.data() + GetTileBegin(tile + 1), 0);
+
+    uint32_t maxCount = 0;
+    for (uint32_t i = tileOffsets[tile]; i < tileOffsets[tile + 1]; i++)
+    {
+        maxCount = std::max(maxCount, ++tileCounts[tilePixels[i] - tileBegin]);
+    }
+
+    tileMaxCounts[tile] = maxCount;
+}
+
+void RasterizeJob::UpdateIntensities(const uint32_t maxCount)
+{
+    // Logarithmic from a single entity at the dimmest to the most crowded pixel of the frame at full intensity, empty pixels stay black.
+    const uint32_t rampCount = std::min(maxCount, maxRampCount);
+    intensities.resize(rampCount + 1);
+    intensities[0] = 0;
+
+    const float inverseMaxLog = 1.0f / std::log(static_cast<float>(rampCount) + 1.0f);
+    for (uint32_t count = 1; count <= rampCount; count++)
+    {
+        intensities[count] = static_cast<uint8_t>(std::max(std::log(static_cast<float>(count) + 1.0f) * inverseMaxLog * 255.0f + 0.5f, 1.0f));
+    }
+}
+
+void RasterizeJob::WriteTile(Slot& slot, const size_t tile) const
+{
+    const size_t tileBegin = GetTileBegin(tile);
+    const size_t tileEnd = GetTileBegin(tile + 1);
+    const uint32_t rampCount = static_cast<uint32_t>(intensities.size() - 1);
+    if (isColor)
+    {
+        for (size_t pixel = tileBegin; pixel < tileEnd; pixel++)
+        {
+            const std::array<uint8_t, 3>& color = heatColors[intensities[std::min(counts[pixel], rampCount)]];
+            std::copy(color.begin(), color.end(), slot.pixels.begin() + static_cast<ptrdiff_t>(pixel * 3));
+        }
+    }
+    else
+    {
+        for (size_t pixel = tileBegin; pixel < tileEnd; pixel++)
+        {
+            slot.pixels[pixel] = intensities[std::min(counts[pixel], rampCount)];
+        }
+    }
+}
+
+void RasterizeJob::WriterLoop()
+{
+#ifdef SCHED_IDLE
+    // Writing is never urgent, only run it on cores the frame loop leaves idle. Without this it takes turns with the workers when every core is busy.
+    const sched_param parameters{};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &parameters);
+#endif
+
+    uint64_t slotIndex = tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+        const uint64_t published = head.load(std::memory_order_acquire);
+        if ((published & ~stoppedFlag) == slotIndex)
+        {
+            if ((published & stoppedFlag) != 0)
+            {
+                return;
+            }
+
+            head.wait(published, std::memory_order_acquire);
+            continue;
+        }
+
+        Write(slots[slotIndex % numSlots]);
+        slotIndex++;
+        tail.store(slotIndex, std::memory_order_release);
+    }
+}
+
+void RasterizeJob::Write(const Slot& slot)
+{
+    // Zero padded so the images sort in frame order.
+    std::string frameIndex = std::to_string(slot.frameIndex);
+    frameIndex.insert(0, frameIndexDigits - std::min(frameIndex.size(), frameIndexDigits), '0');
+
+    // Images that can't be written are skipped, the count at exit shows how many made it.
+    std::ofstream file(pathStem + "_" + frameIndex + pathExtension, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        return;
+    }
+
+    const std::string header = std::string(isColor ? "P6\n" : "P5\n") + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    file.write(header.data(), static_cast<std::streamsize>(header.size()));
+    file.write(reinterpret_cast<const char*>(slot.pixels.data()), static_cast<std::streamsize>(slot.pixels.size()));
+    if (!file)
+    {
+        return;
+    }
+
+    numWritten++;
+    numBytesWritten += header.size() + slot.pixels.size();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Arena.h"
+#include "Entity.h"
+
+// Draws the entities into an image of any size, far finer than the console, and writes every image to a file of its own on a thread of its own.
+// Every entity adds to the pixel it lands on and the image shows those counts on a logarithmic ramp, so a crowd still shows its shape instead of a solid blob.
+// The part of the world the console shows is fit into the image, so the two line up.
+//
+// Entities are projected into pixel indices four at a time and grouped by the band of rows they land in, then every worker adds up the entities of its own band
+// so no two ever touch the same pixel, and every entity is only looked at by one of them.
+// Finished images go to the writer through a lock free single producer, single consumer ring. When the writer falls behind frames are dropped, the frame loop never waits on it.
+// Images are binary PGM, grayscale, or PPM, colored from black through red and yellow to white.
+class RasterizeJob
+{
+public:
+    static constexpr size_t numSlots = 3;
+
+    // On either axis. Pixel indices are worked out in floats and have to stay exact.
+    static constexpr size_t maxImageSize = 4096;
+
+    RasterizeJob(Arena& arena, size_t numEntities, size_t width, size_t height);
+    ~RasterizeJob();
+
+    RasterizeJob(const RasterizeJob&) = delete;
+    RasterizeJob& operator=(const RasterizeJob&) = delete;
+
+    // Only the streams per entity come out of the arena, the image and the counts per tile don't grow with the entities.
+    static size_t GetArenaBytes(size_t numEntities);
+
+    // Images are written next to path with the frame index added to the name, path has to end with .pgm or .ppm and that decides the format.
+    bool Start(const std::string& path);
+
+    // Writes everything drawn so far. No job may still be drawing.
+    void Stop();
+
+    // Frame loop side: draws positions into a free slot, or drops the frame when there is none. Splits the drawing across all workers and returns when done.
+    void Run(const Entity::Positions& positions, uint64_t frameIndex);
+
+    uint64_t GetNumWritten() const;
+    uint64_t GetNumDropped() const;
+    uint64_t GetNumBytesWritten() const;
+
+private:
+    struct Slot
+    {
+        std::vector<uint8_t> pixels;
+        uint64_t frameIndex = 0;
+    };
+
+    // Set on head by Stop, it changes the value the writer sleeps on so it always wakes up for it.
+    static constexpr uint64_t stoppedFlag = 1ull << 63;
+
+    static constexpr uint32_t outsideImage = 0xFFFFFFFF;
+
+    void Project(const Entity::Positions& positions, size_t begin, size_t end);
+    void CountTiles(size_t chunk, size_t begin, size_t end);
+    void GroupByTile(size_t chunk, size_t begin, size_t end);
+    void Accumulate(size_t tile);
+    void UpdateIntensities(uint32_t maxCount);
+    void WriteTile(Slot& slot, size_t tile) const;
+    size_t GetTileBegin(size_t tile) const;
+
+    void WriterLoop();
+    void Write(const Slot& slot);
+
+    size_t width;
+    size_t height;
+    size_t numTiles;
+
+    // Pixel = world * scale + offset, with y flipped so up in the world is up in the image.
+    float scale;
+    float offsetX;
+    float offsetY;
+
+    std::span<uint32_t> pixelIndices; // Per entity, outsideImage for entities that aren't in the image.
+    std::span<uint32_t> tilePixels; // The pixel indices of the entities in the image, grouped by tile.
+    std::vector<uint32_t> rowTiles; // The tile of every row of pixels.
+    std::vector<uint32_t> chunkTileOffsets; // Per chunk of projected entities and tile, first how many land in it and then where they go in tilePixels.
+    std::vector<uint32_t> tileOffsets; // Where every tile's pixels start in tilePixels, and one past the last.
+    std::vector<uint32_t> counts; // Per pixel.
+    std::vector<uint32_t> tileMaxCounts;
+    std::vector<uint8_t> intensities; // Per count, up to the most crowded pixel of the frame.
+    std::array<std::array<uint8_t, 3>, 256> heatColors;
+    bool isColor = false;
+
+    std::array<Slot, numSlots> slots;
+
+    // Written by the frame loop's job and read by the writer. Kept on separate cache lines so the two sides don't share one.
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) uint64_t numDropped = 0;
+
+    // Only touched by the writer thread while it is running.
+    std::string pathStem;
+    std::string pathExtension;
+    uint64_t numWritten = 0;
+    uint64_t numBytesWritten = 0;
+
+    std::thread writer;
+};
@@ -2,14 +2,30 @@
 
 #include <iostream>
 #include <algorithm>
+#include <bit>
+#include <cstring>
+#include <cerrno>
+#include <charconv>
 #include <ncurses.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(_M_X64) // x64
+#include <emmintrin.h>
+#elif defined(__arm__) || defined(__aarch64__) // ARM
+#include <arm_neon.h>
+#endif
 
 #include "Vector.h"
 #include "Clocks.h"
+#include "PerfCounters.h"
+#include "Trace.h"
 
 float RenderJob::cachedWorldWidthCenter = 0.0f;
 float RenderJob::cachedWorldHeightCenter = 0.0f;
 
+// Unchanged gaps shorter than this are redrawn as part of the surrounding changed cells, which is cheaper than moving the cursor past them.
+constexpr size_t maxMergedGap = 8;
+
 enum class DirectionalCharacter
 {
     TOP,
@@ -36,10 +52,39 @@ const std::array<char, static_cast<size_t>(DirectionalCharacter::NUM_DIRECTIONS)
     '<'
 };
 
-RenderJob::RenderJob(const std::array<Entity::Velocity, Entity::numEntities>& velocities)
+const std::array<const char*, static_cast<size_t>(RenderBackend::NUM_BACKENDS)> backendNames
+{
+    "ncurses",
+    "ansi",
+    "headless"
+};
+
+// From a single entity up to the most crowded cell of the frame. Empty cells keep whatever the clear buffer has.
+constexpr std::array<char, 9> densityCharacters
+{
+    '.',
+    ':',
+    '-',
+    '=',
+    '+',
+    '*',
+    '#',
+    '%',
+    '@'
+};
+
+RenderJob::RenderJob(const RenderMode mode, const RenderBackend backend) : renderMode(mode), renderBackend(backend), outputFile(STDOUT_FILENO)
 {
+    if (renderMode == RenderMode::DENSITY)
+    {
+        partialCounts.resize(JobSystem::GetNumWorkers() + 1);
+    }
+    else
+    {
+        partialBuffers.resize(JobSystem::GetNumWorkers() + 1);
+    }
+
     InitializeConsole();
-    InitializeDrawProperties(velocities);
     FillClearBuffer();
     ClearBackBuffer();
 
@@ -47,40 +92,149 @@ RenderJob::RenderJob(const std::array<Entity::Velocity, Entity::numEntities>& ve
     cachedWorldHeightCenter = static_cast<float>(GetCenterForAxis(worldHeight));
 }
 
-std::thread* RenderJob::Run(const std::array<Entity::Position, Entity::numEntities>& positions)
+void RenderJob::Run(const Entity::Positions& positions, const SpatialBins& bins, const std::span<const DrawProperties> frameDrawProperties)
 {
-    auto lambda = [this](const std::array<Entity::Position, Entity::numEntities>& inPositions)
+    Clocks::StartRenderClock();
+    const Trace::Span span("Render");
+
+    Present();
+    ClearBackBuffer();
+    DrawEntities(positions, frameDrawProperties, &bins);
+
+    Clocks::PauseRenderClock();
+}
+
+void RenderJob::DrawEntities(const Entity::Positions& positions, const std::span<const DrawProperties> frameDrawProperties, const SpatialBins* bins)
+{
+    drawProperties = frameDrawProperties;
+    WriteEntities(positions, bins);
+}
+
+void RenderJob::Present(const bool isWholeFrame)
+{
+    if (isWholeFrame)
     {
-        Clocks::StartRenderClock();
+        presentedBuffer.fill('\0');
+    }
 
-        this->SwapBuffers();
-        this->ClearBackBuffer();
-        this->WriteEntities(inPositions);
+    SwapBuffers();
+}
 
-        Clocks::PauseRenderClock();
-    };
+void RenderJob::SetOutputFile(const int file)
+{
+    outputFile = file;
+}
+
+size_t RenderJob::GetNumCells()
+{
+    return bufferSize;
+}
+
+void RenderJob::InitializeDrawProperties(const std::span<DrawProperties> drawProperties, const Entity::Velocities& velocities)
+{
+    for (size_t i = 0; i < drawProperties.size(); i++)
+    {
+        drawProperties[i].direction = ConvertDirectionToCharacter(Vector2(velocities.directionX[i], velocities.directionY[i]));
+    }
+}
+
+void RenderJob::UpdateDrawProperties(const std::span<DrawProperties> drawProperties, const Entity::Velocities& velocities, const ActiveSet& activeSet)
+{
+    activeSet.ForEachSwappedSlot([drawProperties, &velocities](const uint32_t slot)
+    {
+        drawProperties[slot].direction = ConvertDirectionToCharacter(Vector2(velocities.directionX[slot], velocities.directionY[slot]));
+    });
+}
 
-    return new std::thread(lambda, std::ref(positions));
+void RenderJob::UpdateDrawProperties(const std::span<DrawProperties> drawProperties, const Entity::Velocities& velocities, const size_t begin, const size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        drawProperties[i].direction = ConvertDirectionToCharacter(Vector2(velocities.directionX[i], velocities.directionY[i]));
+    }
 }
 
 void RenderJob::ShutDownConsole()
 {
-    endwin();
+    switch (renderBackend)
+    {
+    case RenderBackend::NCURSES:
+        endwin();
+        break;
+    case RenderBackend::ANSI:
+        // The setup is still waiting here if no frame was ever presented, the console was never touched then. The cursor is shown again on the line below the world.
+        ansiBuffer.clear();
+        ansiBuffer.append("\x1b[0m\x1b[?25h");
+        PresentRun(worldHeight, 0, nullptr, 0);
+        WriteAnsiBuffer();
+        break;
+    default:
+        break;
+    }
 }
 
-void RenderJob::InitializeConsole()
+const char* RenderJob::GetBackendName(const RenderBackend backend)
+{
+    return backendNames[static_cast<size_t>(backend)];
+}
+
+bool RenderJob::ParseBackendName(const std::string& name, RenderBackend& outBackend)
+{
+    for (size_t i = 0; i < backendNames.size(); i++)
+    {
+        if (name == backendNames[i])
+        {
+            outBackend = static_cast<RenderBackend>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+SpatialBins::Bounds RenderJob::GetVisibleWorldBounds()
+{
+    // GetConsoleCoordsFromWorldPos solved for the edges of the console.
+    const float widthCenter = static_cast<float>(GetCenterForAxis(worldWidth));
+    const float heightCenter = static_cast<float>(GetCenterForAxis(worldHeight));
+    return SpatialBins::Bounds{ 0.5f - widthCenter, heightCenter - static_cast<float>(worldHeight + 1), static_cast<float>(consoleWidth + 1) * 0.5f - widthCenter, heightCenter - 1.0f };
+}
+
+// A cell is half a world unit wide and one tall, so 8x8 bins are 16x8 cells.
+constexpr float visibilityBinSize = 8.0f;
+
+SpatialBins RenderJob::CreateVisibilityBins(Arena& arena, const size_t numEntities, const size_t chunkSize)
+{
+    return SpatialBins(arena, numEntities, chunkSize, GetVisibleWorldBounds(), visibilityBinSize, visibilityBinSize);
+}
+
+size_t RenderJob::GetVisibilityBinsArenaBytes(const size_t numEntities, const size_t chunkSize)
 {
-    initscr();
-    cbreak();
-    noecho();
-    curs_set(0);
+    return SpatialBins::GetArenaBytes(numEntities, chunkSize, GetVisibleWorldBounds(), visibilityBinSize, visibilityBinSize);
 }
 
-void RenderJob::InitializeDrawProperties(const std::array<Entity::Velocity, Entity::numEntities>& velocities)
+void RenderJob::InitializeConsole()
 {
-    for (size_t i = 0; i < Entity::numEntities; i++)
+    switch (renderBackend)
     {
-        drawProperties[i].direction = ConvertDirectionToCharacter(velocities[i].direction);
+    case RenderBackend::NCURSES:
+        // The console might already have been set up by whoever owns the terminal, the benchmark for example points it at /dev/null.
+        if (stdscr == nullptr)
+        {
+            initscr();
+        }
+
+        cbreak();
+        noecho();
+        curs_set(0);
+        break;
+    case RenderBackend::ANSI:
+        // Room for every cell and a cursor move in front of most of them. Clearing the screen and hiding the cursor goes out with the first frame.
+        ansiBuffer.reserve(bufferSize * 4);
+        ansiBuffer.append("\x1b[?25l\x1b[2J");
+        break;
+    default:
+        break;
     }
 }
 
@@ -95,11 +249,6 @@ void RenderJob::WriteToBuffer(std::array<char, RenderJob::bufferSize>& buffer, c
     buffer[index] = character;
 }
 
-void RenderJob::WriteToBackBuffer(const size_t x, const size_t y, const char character)
-{
-    WriteToBuffer(drawBuffer, x, y, character);
-}
-
 void RenderJob::WriteToClearBuffer(const size_t x, const size_t y, const char character)
 {
     WriteToBuffer(clearBuffer, x, y, character);
@@ -117,19 +266,171 @@ void RenderJob::FillClearBuffer()
 
 void RenderJob::ClearBackBuffer()
 {
+    const Trace::Span span("ClearBackBuffer");
     drawBuffer = clearBuffer;
 }
 
 void RenderJob::SwapBuffers()
 {
-    for (size_t i = 0; i < consoleWidth * worldHeight; i++)
+    if (renderBackend == RenderBackend::HEADLESS)
+    {
+        return;
+    }
+
+    const PerfCounters::Scope scope(PerfCounters::Job::SWAP_BUFFERS);
+    const Trace::Span span("SwapBuffers");
+    bool hasChanges = false;
+    for (size_t y = 0; y < worldHeight; y++)
+    {
+        const char* drawRow = drawBuffer.data() + y * consoleWidth;
+        char* presentedRow = presentedBuffer.data() + y * consoleWidth;
+
+        size_t runStart = FindNextDifference(drawRow, presentedRow, 0, consoleWidth);
+        while (runStart < consoleWidth)
+        {
+            size_t runEnd = FindNextMatch(drawRow, presentedRow, runStart, consoleWidth);
+            size_t nextRunStart = FindNextDifference(drawRow, presentedRow, runEnd, consoleWidth);
+            while (nextRunStart < consoleWidth && nextRunStart - runEnd <= maxMergedGap)
+            {
+                runEnd = FindNextMatch(drawRow, presentedRow, nextRunStart, consoleWidth);
+                nextRunStart = FindNextDifference(drawRow, presentedRow, runEnd, consoleWidth);
+            }
+
+            PresentRun(y, runStart, drawRow + runStart, runEnd - runStart);
+            std::memcpy(presentedRow + runStart, drawRow + runStart, runEnd - runStart);
+            hasChanges = true;
+
+            runStart = nextRunStart;
+        }
+    }
+
+    if (renderBackend == RenderBackend::NCURSES && hasChanges)
+    {
+        refresh();
+    }
+    else if (renderBackend == RenderBackend::ANSI)
+    {
+        WriteAnsiBuffer();
+    }
+}
+
+void RenderJob::PresentRun(const size_t row, const size_t column, const char* characters, const size_t count)
+{
+    if (renderBackend == RenderBackend::NCURSES)
+    {
+        mvaddnstr(static_cast<int>(row), static_cast<int>(column), characters, static_cast<int>(count));
+        return;
+    }
+
+    auto appendNumber = [this](const size_t number)
+    {
+        std::array<char, 20> digits;
+        ansiBuffer.append(digits.data(), std::to_chars(digits.data(), digits.data() + digits.size(), number).ptr);
+    };
+
+    // Cursor position is one based, ESC [ row ; column H.
+    ansiBuffer.append("\x1b[");
+    appendNumber(row + 1);
+    ansiBuffer.push_back(';');
+    appendNumber(column + 1);
+    ansiBuffer.push_back('H');
+    ansiBuffer.append(characters, count);
+}
+
+void RenderJob::WriteAnsiBuffer()
+{
+    // A single write unless the terminal takes less than all of it at once.
+    const char* data = ansiBuffer.data();
+    size_t remaining = ansiBuffer.size();
+    while (remaining > 0)
     {
-        const size_t x = i % consoleWidth;
-        const size_t y = i / consoleWidth;
-        mvaddch(y, x, drawBuffer[i]);
+        const ssize_t written = write(outputFile, data, remaining);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        data += written;
+        remaining -= static_cast<size_t>(written);
     }
 
-    refresh();
+    ansiBuffer.clear();
+}
+
+size_t RenderJob::FindNextDifference(const char* a, const char* b, size_t begin, const size_t end)
+{
+#if defined(__x86_64__) || defined(_M_X64) // x64
+    for (; begin + 16 <= end; begin += 16)
+    {
+        const __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + begin)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + begin)));
+        const uint32_t differentMask = ~static_cast<uint32_t>(_mm_movemask_epi8(equal)) & 0xFFFF;
+        if (differentMask != 0)
+        {
+            return begin + std::countr_zero(differentMask);
+        }
+    }
+#elif defined(__aarch64__) // ARM
+    for (; begin + 16 <= end; begin += 16)
+    {
+        const uint8x16_t equal = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(a + begin)), vld1q_u8(reinterpret_cast<const uint8_t*>(b + begin)));
+        // Narrowing shift packs the comparison into four bits per byte.
+        const uint64_t differentMask = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+        if (differentMask != 0)
+        {
+            return begin + std::countr_zero(differentMask) / 4;
+        }
+    }
+#endif
+
+    for (; begin < end; begin++)
+    {
+        if (a[begin] != b[begin])
+        {
+            return begin;
+        }
+    }
+
+    return end;
+}
+
+size_t RenderJob::FindNextMatch(const char* a, const char* b, size_t begin, const size_t end)
+{
+#if defined(__x86_64__) || defined(_M_X64) // x64
+    for (; begin + 16 <= end; begin += 16)
+    {
+        const __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + begin)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + begin)));
+        const uint32_t equalMask = static_cast<uint32_t>(_mm_movemask_epi8(equal));
+        if (equalMask != 0)
+        {
+            return begin + std::countr_zero(equalMask);
+        }
+    }
+#elif defined(__aarch64__) // ARM
+    for (; begin + 16 <= end; begin += 16)
+    {
+        const uint8x16_t equal = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(a + begin)), vld1q_u8(reinterpret_cast<const uint8_t*>(b + begin)));
+        const uint64_t equalMask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+        if (equalMask != 0)
+        {
+            return begin + std::countr_zero(equalMask) / 4;
+        }
+    }
+#endif
+
+    for (; begin < end; begin++)
+    {
+        if (a[begin] == b[begin])
+        {
+            return begin;
+        }
+    }
+
+    return end;
 }
 
 char RenderJob::ConvertDirectionToCharacter(Vector2 direction)
@@ -154,10 +455,19 @@ size_t RenderJob::GetCenterForAxis(const size_t axisSize)
     return axisSize / 2 - 1;
 }
 
-void RenderJob::GetConsoleCoordsFromWorldPos(const Vector2& position, size_t& outX, size_t& outY)
+bool RenderJob::GetConsoleCoordsFromWorldPos(const Vector2& position, size_t& outX, size_t& outY)
 {
-    outX = static_cast<size_t>((position.x + cachedWorldWidthCenter) * 2.0f) - 1;
-    outY = static_cast<size_t>(-position.y + cachedWorldHeightCenter) - 1;
+    // Range checked before converting, the coordinates of entities far outside the world don't fit in an integer.
+    const float consoleX = (position.x + cachedWorldWidthCenter) * 2.0f;
+    const float consoleY = -position.y + cachedWorldHeightCenter;
+    if (!(consoleX >= 1.0f && consoleX < static_cast<float>(consoleWidth + 1) && consoleY >= 1.0f && consoleY < static_cast<float>(worldHeight + 1)))
+    {
+        return false;
+    }
+
+    outX = static_cast<size_t>(consoleX) - 1;
+    outY = static_cast<size_t>(consoleY) - 1;
+    return true;
 }
 
 void RenderJob::WriteWorld()
@@ -210,14 +520,96 @@ void RenderJob::WriteOrigo()
     WriteToClearBuffer(GetCenterForAxis(consoleWidth), GetCenterForAxis(worldHeight), 'O');
 }
 
-void RenderJob::WriteEntities(const std::array<Entity::Position, Entity::numEntities>& positions)
+template<typename RangeFunction, typename IndicesFunction>
+void RenderJob::ForEachVisibleEntities(const SpatialBins& bins, const size_t numEntities, const size_t beginChunk, const size_t endChunk, const RangeFunction& rangeFunction, const IndicesFunction& indicesFunction)
 {
-    for (size_t i = 0; i < positions.size(); i++)
+    const SpatialBins::Bounds visibleBounds = GetVisibleWorldBounds();
+    for (size_t chunk = beginChunk; chunk < endChunk; chunk++)
     {
-        size_t x;
-        size_t y;
-        GetConsoleCoordsFromWorldPos(positions[i].pos, x, y);
-        WriteToBackBuffer(x, y, drawProperties[i].direction);
+        const size_t chunkBegin = chunk * bins.GetChunkSize();
+        const size_t chunkEnd = std::min(chunkBegin + bins.GetChunkSize(), numEntities);
+
+        if (!bins.IsSorted(chunk))
+        {
+            rangeFunction(chunkBegin, chunkEnd);
+            continue;
+        }
+
+        for (size_t bin = 0; bin < bins.GetNumBins(); bin++)
+        {
+            if (bins.Overlaps(bin, visibleBounds))
+            {
+                indicesFunction(bins.GetIndices(chunk, bin));
+            }
+        }
+    }
+}
+
+void RenderJob::WriteEntities(const Entity::Positions& positions, const SpatialBins* bins)
+{
+    // One contiguous range of entities per partial buffer, merging the buffers in order keeps the last entity written to a cell on top, same as writing them all on one thread.
+    // With bins the ranges are made of the simulation's chunks instead, which are in entity order too, and only the bins that overlap the console are walked.
+    // Chunks past the live entities are left over from entities that have been despawned.
+    const size_t numItems = bins != nullptr ? std::min(bins->GetNumChunks(), (positions.x.size() + bins->GetChunkSize() - 1) / bins->GetChunkSize()) : positions.x.size();
+    const size_t maxPartialBuffers = JobSystem::GetNumWorkers() + 1;
+    const size_t itemsPerBuffer = std::max<size_t>((numItems + maxPartialBuffers - 1) / maxPartialBuffers, 1);
+    const size_t numPartialBuffers = (numItems + itemsPerBuffer - 1) / itemsPerBuffer;
+
+    if (renderMode == RenderMode::DENSITY)
+    {
+        JobSystem::ParallelFor(numItems, itemsPerBuffer, [this, &positions, bins, itemsPerBuffer](const size_t begin, const size_t end)
+        {
+            const PerfCounters::Scope scope(PerfCounters::Job::WRITE_ENTITIES);
+            const Trace::Span span("WriteEntities");
+            std::array<uint32_t, bufferSize>& counts = partialCounts[begin / itemsPerBuffer];
+            counts.fill(0);
+            if (bins == nullptr)
+            {
+                CountEntityRange(counts.data(), positions, begin, end);
+                return;
+            }
+
+            ForEachVisibleEntities(*bins, positions.x.size(), begin, end, [&counts, &positions](const size_t rangeBegin, const size_t rangeEnd)
+            {
+                CountEntityRange(counts.data(), positions, rangeBegin, rangeEnd);
+            },
+            [&counts, &positions](const std::span<const uint32_t> indices)
+            {
+                CountEntityIndices(counts.data(), positions, indices);
+            });
+        });
+
+        const PerfCounters::Scope scope(PerfCounters::Job::WRITE_ENTITIES);
+        const Trace::Span span("MergePartialCounts");
+        MergePartialCounts(numPartialBuffers);
+    }
+    else
+    {
+        JobSystem::ParallelFor(numItems, itemsPerBuffer, [this, &positions, bins, itemsPerBuffer](const size_t begin, const size_t end)
+        {
+            const PerfCounters::Scope scope(PerfCounters::Job::WRITE_ENTITIES);
+            const Trace::Span span("WriteEntities");
+            std::array<char, bufferSize>& partialBuffer = partialBuffers[begin / itemsPerBuffer];
+            partialBuffer.fill('\0');
+            if (bins == nullptr)
+            {
+                WriteEntityRange(partialBuffer.data(), positions, begin, end);
+                return;
+            }
+
+            ForEachVisibleEntities(*bins, positions.x.size(), begin, end, [this, &partialBuffer, &positions](const size_t rangeBegin, const size_t rangeEnd)
+            {
+                WriteEntityRange(partialBuffer.data(), positions, rangeBegin, rangeEnd);
+            },
+            [this, &partialBuffer, &positions](const std::span<const uint32_t> indices)
+            {
+                WriteEntityIndices(partialBuffer.data(), positions, indices);
+            });
+        });
+
+        const PerfCounters::Scope scope(PerfCounters::Job::WRITE_ENTITIES);
+        const Trace::Span span("MergePartialBuffers");
+        MergePartialBuffers(numPartialBuffers);
     }
 
     // We no longer make sure to keep the entities inside the grid. We let them wander outside, then we draw the borders on top after wards.
@@ -226,4 +618,222 @@ void RenderJob::WriteEntities(const std::array<Entity::Position, Entity::numEnti
     WriteHorizontal(drawBuffer, worldHeight - 1);
     WriteVertical(drawBuffer, 0);
     WriteVertical(drawBuffer, consoleWidth - 1);
-}
\ No newline at end of file
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__)
+uint32_t RenderJob::GetConsoleCoordsFromWorldPosFourLane(const float* positionsX, const float* positionsY, std::array<int32_t, 4>& outColumns, std::array<int32_t, 4>& outRows)
+{
+    // Same projection and range check as GetConsoleCoordsFromWorldPos, four entities at a time. Returns a bit per entity that is inside the console.
+#if defined(__x86_64__) || defined(_M_X64) // x64
+    const __m128 consoleX = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(positionsX), _mm_set1_ps(cachedWorldWidthCenter)), _mm_set1_ps(2.0f));
+    const __m128 consoleY = _mm_sub_ps(_mm_set1_ps(cachedWorldHeightCenter), _mm_loadu_ps(positionsY));
+    const __m128 isInsideX = _mm_and_ps(_mm_cmpge_ps(consoleX, _mm_set1_ps(1.0f)), _mm_cmplt_ps(consoleX, _mm_set1_ps(static_cast<float>(consoleWidth + 1))));
+    const __m128 isInsideY = _mm_and_ps(_mm_cmpge_ps(consoleY, _mm_set1_ps(1.0f)), _mm_cmplt_ps(consoleY, _mm_set1_ps(static_cast<float>(worldHeight + 1))));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(outColumns.data()), _mm_sub_epi32(_mm_cvttps_epi32(consoleX), _mm_set1_epi32(1)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(outRows.data()), _mm_sub_epi32(_mm_cvttps_epi32(consoleY), _mm_set1_epi32(1)));
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_and_ps(isInsideX, isInsideY)));
+#else // ARM
+    const float32x4_t consoleX = vmulq_f32(vaddq_f32(vld1q_f32(positionsX), vdupq_n_f32(cachedWorldWidthCenter)), vdupq_n_f32(2.0f));
+    const float32x4_t consoleY = vsubq_f32(vdupq_n_f32(cachedWorldHeightCenter), vld1q_f32(positionsY));
+    const uint32x4_t isInsideX = vandq_u32(vcgeq_f32(consoleX, vdupq_n_f32(1.0f)), vcltq_f32(consoleX, vdupq_n_f32(static_cast<float>(consoleWidth + 1))));
+    const uint32x4_t isInsideY = vandq_u32(vcgeq_f32(consoleY, vdupq_n_f32(1.0f)), vcltq_f32(consoleY, vdupq_n_f32(static_cast<float>(worldHeight + 1))));
+
+    vst1q_s32(outColumns.data(), vsubq_s32(vcvtq_s32_f32(consoleX), vdupq_n_s32(1)));
+    vst1q_s32(outRows.data(), vsubq_s32(vcvtq_s32_f32(consoleY), vdupq_n_s32(1)));
+    const uint32x4_t laneBits = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(vandq_u32(isInsideX, isInsideY), laneBits));
+#endif
+}
+#endif
+
+void RenderJob::WriteEntityRange(char* buffer, const Entity::Positions& positions, size_t begin, const size_t end) const
+{
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__)
+    for (; begin + 4 <= end; begin += 4)
+    {
+        std::array<int32_t, 4> columns;
+        std::array<int32_t, 4> rows;
+        uint32_t insideMask = GetConsoleCoordsFromWorldPosFourLane(&positions.x[begin], &positions.y[begin], columns, rows);
+        while (insideMask != 0)
+        {
+            const uint32_t lane = static_cast<uint32_t>(std::countr_zero(insideMask));
+            insideMask &= insideMask - 1;
+            buffer[rows[lane] * consoleWidth + columns[lane]] = drawProperties[begin + lane].direction;
+        }
+    }
+#endif
+
+    for (; begin < end; begin++)
+    {
+        size_t x;
+        size_t y;
+        if (GetConsoleCoordsFromWorldPos(Vector2(positions.x[begin], positions.y[begin]), x, y))
+        {
+            buffer[y * consoleWidth + x] = drawProperties[begin].direction;
+        }
+    }
+}
+
+void RenderJob::WriteEntityIndices(char* buffer, const Entity::Positions& positions, const std::span<const uint32_t> indices) const
+{
+    size_t i = 0;
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__)
+    for (; i + 4 <= indices.size(); i += 4)
+    {
+        const std::array<float, 4> positionsX{ positions.x[indices[i]], positions.x[indices[i + 1]], positions.x[indices[i + 2]], positions.x[indices[i + 3]] };
+        const std::array<float, 4> positionsY{ positions.y[indices[i]], positions.y[indices[i + 1]], positions.y[indices[i + 2]], positions.y[indices[i + 3]] };
+        std::array<int32_t, 4> columns;
+        std::array<int32_t, 4> rows;
+        uint32_t insideMask = GetConsoleCoordsFromWorldPosFourLane(positionsX.data(), positionsY.data(), columns, rows);
+        while (insideMask != 0)
+        {
+            const uint32_t lane = static_cast<uint32_t>(std::countr_zero(insideMask));
+            insideMask &= insideMask - 1;
+            buffer[rows[lane] * consoleWidth + columns[lane]] = drawProperties[indices[i + lane]].direction;
+        }
+    }
+#endif
+
+    for (; i < indices.size(); i++)
+    {
+        size_t x;
+        size_t y;
+        if (GetConsoleCoordsFromWorldPos(Vector2(positions.x[indices[i]], positions.y[indices[i]]), x, y))
+        {
+            buffer[y * consoleWidth + x] = drawProperties[indices[i]].direction;
+        }
+    }
+}
+
+void RenderJob::MergePartialBuffers(const size_t numPartialBuffers)
+{
+    for (size_t bufferIndex = 0; bufferIndex < numPartialBuffers; bufferIndex++)
+    {
+        const char* partialBuffer = partialBuffers[bufferIndex].data();
+        size_t i = 0;
+
+#if defined(__x86_64__) || defined(_M_X64) // x64
+        const __m128i zeroSixteenLane = _mm_setzero_si128();
+        for (; i + 16 <= bufferSize; i += 16)
+        {
+            const __m128i partial = _mm_loadu_si128(reinterpret_cast<const __m128i*>(partialBuffer + i));
+            const __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(drawBuffer.data() + i));
+            const __m128i isUntouched = _mm_cmpeq_epi8(partial, zeroSixteenLane);
+            const __m128i merged = _mm_or_si128(_mm_and_si128(isUntouched, current), _mm_andnot_si128(isUntouched, partial));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(drawBuffer.data() + i), merged);
+        }
+#elif defined(__arm__) || defined(__aarch64__) // ARM
+        for (; i + 16 <= bufferSize; i += 16)
+        {
+            const uint8x16_t partial = vld1q_u8(reinterpret_cast<const uint8_t*>(partialBuffer + i));
+            const uint8x16_t current = vld1q_u8(reinterpret_cast<const uint8_t*>(drawBuffer.data() + i));
+            const uint8x16_t isUntouched = vceqq_u8(partial, vdupq_n_u8(0));
+            vst1q_u8(reinterpret_cast<uint8_t*>(drawBuffer.data() + i), vbslq_u8(isUntouched, current, partial));
+        }
+#endif
+
+        for (; i < bufferSize; i++)
+        {
+            if (partialBuffer[i] != '\0')
+            {
+                drawBuffer[i] = partialBuffer[i];
+            }
+        }
+    }
+}
+
+void RenderJob::CountEntityRange(uint32_t* counts, const Entity::Positions& positions, size_t begin, const size_t end)
+{
+    // Unlike the direction pass there's no draw properties stream to read, just the positions.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__)
+    for (; begin + 4 <= end; begin += 4)
+    {
+        std::array<int32_t, 4> columns;
+        std::array<int32_t, 4> rows;
+        uint32_t insideMask = GetConsoleCoordsFromWorldPosFourLane(&positions.x[begin], &positions.y[begin], columns, rows);
+        while (insideMask != 0)
+        {
+            const uint32_t lane = static_cast<uint32_t>(std::countr_zero(insideMask));
+            insideMask &= insideMask - 1;
+            counts[rows[lane] * consoleWidth + columns[lane]]++;
+        }
+    }
+#endif
+
+    for (; begin < end; begin++)
+    {
+        size_t x;
+        size_t y;
+        if (GetConsoleCoordsFromWorldPos(Vector2(positions.x[begin], positions.y[begin]), x, y))
+        {
+            counts[y * consoleWidth + x]++;
+        }
+    }
+}
+
+void RenderJob::CountEntityIndices(uint32_t* counts, const Entity::Positions& positions, const std::span<const uint32_t> indices)
+{
+    size_t i = 0;
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__)
+    for (; i + 4 <= indices.size(); i += 4)
+    {
+        const std::array<float, 4> positionsX{ positions.x[indices[i]], positions.x[indices[i + 1]], positions.x[indices[i + 2]], positions.x[indices[i + 3]] };
+        const std::array<float, 4> positionsY{ positions.y[indices[i]], positions.y[indices[i + 1]], positions.y[indices[i + 2]], positions.y[indices[i + 3]] };
+        std::array<int32_t, 4> columns;
+        std::array<int32_t, 4> rows;
+        uint32_t insideMask = GetConsoleCoordsFromWorldPosFourLane(positionsX.data(), positionsY.data(), columns, rows);
+        while (insideMask != 0)
+        {
+            const uint32_t lane = static_cast<uint32_t>(std::countr_zero(insideMask));
+            insideMask &= insideMask - 1;
+            counts[rows[lane] * consoleWidth + columns[lane]]++;
+        }
+    }
+#endif
+
+    for (; i < indices.size(); i++)
+    {
+        size_t x;
+        size_t y;
+        if (GetConsoleCoordsFromWorldPos(Vector2(positions.x[indices[i]], positions.y[indices[i]]), x, y))
+        {
+            counts[y * consoleWidth + x]++;
+        }
+    }
+}
+
+void RenderJob::MergePartialCounts(const size_t numPartialBuffers)
+{
+    if (numPartialBuffers == 0)
+    {
+        return;
+    }
+
+    std::array<uint32_t, bufferSize>& totalCounts = partialCounts[0];
+    for (size_t bufferIndex = 1; bufferIndex < numPartialBuffers; bufferIndex++)
+    {
+        const std::array<uint32_t, bufferSize>& counts = partialCounts[bufferIndex];
+        for (size_t i = 0; i < bufferSize; i++)
+        {
+            totalCounts[i] += counts[i];
+        }
+    }
+
+    uint32_t maxCount = 0;
+    for (const uint32_t count : totalCounts)
+    {
+        maxCount = std::max(maxCount, count);
+    }
+
+    // Logarithmic ramp, so a handful of entities still shows up next to a cell with thousands in it.
+    const uint32_t maxMagnitude = static_cast<uint32_t>(std::bit_width(maxCount));
+    for (size_t i = 0; i < bufferSize; i++)
+    {
+        if (totalCounts[i] != 0)
+        {
+            const uint32_t magnitude = static_cast<uint32_t>(std::bit_width(totalCounts[i])) - 1;
+            drawBuffer[i] = densityCharacters[magnitude * densityCharacters.size() / maxMagnitude];
+        }
+    }
+}
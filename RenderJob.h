@@ -1,39 +1,104 @@
-#include <thread>
+#pragma once
+
 #include <array>
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
 
 #include "Entity.h"
+#include "Arena.h"
+#include "JobSystem.h"
+#include "SpatialBins.h"
+#include "ActiveSet.h"
 
 struct DrawProperties
 {
     char direction;
 };
 
+enum class RenderMode
+{
+    DIRECTION, // Every entity is drawn as its direction, the last one written to a cell is the one that shows.
+    DENSITY, // Every cell shows how many entities are in it on a logarithmic glyph ramp.
+};
+
+// Where a drawn frame ends up. Drawing is the same for all of them, only presenting it differs.
+enum class RenderBackend
+{
+    NCURSES, // The changed cells are handed to ncurses, which works out what to send to the terminal.
+    ANSI, // The changed cells are written to the terminal as ANSI escape sequences, the whole frame in a single write.
+    HEADLESS, // Nothing is presented, frames are only drawn. For measuring without a terminal.
+
+    NUM_BACKENDS
+};
+
 class RenderJob
 {
 public:
-    explicit RenderJob(const std::array<Entity::Velocity, Entity::numEntities>& velocities);
-    std::thread* Run(const std::array<Entity::Position, Entity::numEntities>& positions);
-    static void ShutDownConsole();
+    explicit RenderJob(RenderMode mode = RenderMode::DIRECTION, RenderBackend backend = RenderBackend::NCURSES);
+    // Draws the frame and presents it, returns when done. Splits the drawing across all workers.
+    // What is drawn for every entity comes from drawProperties, in the same slots as positions.
+    void Run(const Entity::Positions& positions, const SpatialBins& bins, std::span<const DrawProperties> drawProperties);
+    void ShutDownConsole();
+
+    // The two halves of Run, for measuring them on their own. DrawEntities draws on top of whatever is in the back buffer and Present hands it to the backend,
+    // after forgetting what is on screen if asked to so the whole frame is presented instead of just what changed.
+    void DrawEntities(const Entity::Positions& positions, std::span<const DrawProperties> drawProperties, const SpatialBins* bins = nullptr);
+    void Present(bool isWholeFrame = false);
+
+    // Where the ANSI backend writes its frames, stdout unless set.
+    void SetOutputFile(int file);
+
+    static size_t GetNumCells();
+
+    static const char* GetBackendName(RenderBackend backend);
+    static bool ParseBackendName(const std::string& name, RenderBackend& outBackend);
+
+    // What is drawn for an entity is worked out from its direction when it is created. The renderer never sees the velocities, the streams are kept by whoever hands it frames.
+    static void InitializeDrawProperties(std::span<DrawProperties> drawProperties, const Entity::Velocities& velocities);
+
+    // Redraws every entity the active set swapped since, so what is drawn follows the entities to their new slots and spawned entities get drawn as themselves.
+    static void UpdateDrawProperties(std::span<DrawProperties> drawProperties, const Entity::Velocities& velocities, const ActiveSet& activeSet);
+
+    // Redraws entities [begin, end), for when their directions changed in place.
+    static void UpdateDrawProperties(std::span<DrawProperties> drawProperties, const Entity::Velocities& velocities, size_t begin, size_t end);
+
+    // The part of the world that ends up on the console, and bins over it whose edges line up with the console cells.
+    static SpatialBins::Bounds GetVisibleWorldBounds();
+    static SpatialBins CreateVisibilityBins(Arena& arena, size_t numEntities, size_t chunkSize);
+    static size_t GetVisibilityBinsArenaBytes(size_t numEntities, size_t chunkSize);
 
 private:
-    static void InitializeConsole();
-    void InitializeDrawProperties(const std::array<Entity::Velocity, Entity::numEntities>& velocities);
+    void InitializeConsole();
 
-    inline void WriteToBackBuffer(const size_t x, const size_t y, const char character);
     inline void WriteToClearBuffer(const size_t x, const size_t y, const char character);
     void FillClearBuffer();
     void ClearBackBuffer();
     void SwapBuffers();
+    void PresentRun(size_t row, size_t column, const char* characters, size_t count);
+    void WriteAnsiBuffer();
 
     static char ConvertDirectionToCharacter(Vector2 direction);
     static inline size_t GetCenterForAxis(const size_t axisSize);
-    static inline void GetConsoleCoordsFromWorldPos(const Vector2& position, size_t& outX, size_t& outY);
+    static inline bool GetConsoleCoordsFromWorldPos(const Vector2& position, size_t& outX, size_t& outY);
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__)
+    static inline uint32_t GetConsoleCoordsFromWorldPosFourLane(const float* positionsX, const float* positionsY, std::array<int32_t, 4>& outColumns, std::array<int32_t, 4>& outRows);
+#endif
 
     void WriteWorld();
     void WriteXAxis();
     void WriteYAxis();
     void WriteOrigo();
-    void WriteEntities(const std::array<Entity::Position, Entity::numEntities>& positions);
+    void WriteEntities(const Entity::Positions& positions, const SpatialBins* bins = nullptr);
+    template<typename RangeFunction, typename IndicesFunction>
+    static void ForEachVisibleEntities(const SpatialBins& bins, const size_t numEntities, const size_t beginChunk, const size_t endChunk, const RangeFunction& rangeFunction, const IndicesFunction& indicesFunction);
+    void WriteEntityRange(char* buffer, const Entity::Positions& positions, size_t begin, const size_t end) const;
+    void WriteEntityIndices(char* buffer, const Entity::Positions& positions, std::span<const uint32_t> indices) const;
+    void MergePartialBuffers(const size_t numPartialBuffers);
+    static void CountEntityRange(uint32_t* counts, const Entity::Positions& positions, size_t begin, const size_t end);
+    static void CountEntityIndices(uint32_t* counts, const Entity::Positions& positions, std::span<const uint32_t> indices);
+    void MergePartialCounts(const size_t numPartialBuffers);
 
 private:
     const static size_t worldWidth = 83;
@@ -46,12 +111,29 @@ private:
 
     std::array<char, bufferSize> clearBuffer{};
     std::array<char, bufferSize> drawBuffer{};
+    std::array<char, bufferSize> presentedBuffer{}; // What is currently on screen, starts out as '\0' which is never drawn so the first frame is presented in full.
 
-    std::array<DrawProperties, Entity::numEntities> drawProperties{};
+    std::span<const DrawProperties> drawProperties; // Of the frame being drawn.
+
+    // Every worker writes its range of entities into a private buffer, where '\0' means untouched, and they are merged in entity order afterwards.
+    std::vector<std::array<char, bufferSize>> partialBuffers;
+
+    // Density mode counts entities per cell the same way, one set of counts per worker that are summed up afterwards.
+    std::vector<std::array<uint32_t, bufferSize>> partialCounts;
+
+    RenderMode renderMode;
+    RenderBackend renderBackend;
+
+    // The ANSI backend builds up everything a frame changes here and writes it to outputFile in one go.
+    std::string ansiBuffer;
+    int outputFile;
 
 private:
     static inline void WriteToBuffer(std::array<char, bufferSize>& buffer, const size_t x, const size_t y, const char character);
     static void WriteHorizontal(std::array<char, bufferSize>& buffer, const size_t row);
     static void WriteVertical(std::array<char, bufferSize>& buffer, const size_t column);
+
+    static size_t FindNextDifference(const char* a, const char* b, size_t begin, const size_t end);
+    static size_t FindNextMatch(const char* a, const char* b, size_t begin, const size_t end);
 };
 
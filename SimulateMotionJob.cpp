@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <array>
 
 #if defined(__x86_64__) || defined(_M_X64) // x64
 #include <immintrin.h>
@@ -10,113 +11,98 @@
 #endif
 
 #include "Clocks.h"
-//#define RUN_WITHOUT_SIMD
+#include "PerfCounters.h"
+#include "Trace.h"
 
 namespace SimulateMotionJob
 {
     constexpr float gravity = 9.82f;
+    constexpr size_t floatsPerCacheLine = Entity::streamAlignment / sizeof(float);
 
-    inline void IterateAndUpdateMotionOnRemaining(std::array<Entity::Position, Entity::numEntities>& positions, std::array<Entity::Velocity, Entity::numEntities>& velocities, std::array<Entity::Physics, Entity::numEntities>& physics, const size_t startIndex, const float gravityDelta)
+    size_t grainSize = defaultGrainSize;
+
+    void SetGrainSize(const size_t size)
     {
-        const float deltaTime = Clocks::GetDeltaTime();
-        for (size_t i = startIndex; i < velocities.size(); i++)
+        const size_t numCacheLines = std::max<size_t>((size + floatsPerCacheLine - 1) / floatsPerCacheLine, 1);
+        grainSize = numCacheLines * floatsPerCacheLine;
+    }
+
+    size_t GetGrainSize()
+    {
+        return grainSize;
+    }
+
+    void UpdateMotionScalar(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, const size_t begin, const size_t end, const float deltaTime)
+    {
+        const float gravityDelta = gravity * deltaTime;
+        for (size_t i = begin; i < end; i++)
         {
-            physics[i].acceleration = physics[i].acceleration - gravityDelta;
-            velocities[i].speed = std::max(velocities[i].speed + physics[i].acceleration * deltaTime, 0.0f);
+            physics.acceleration[i] = physics.acceleration[i] - gravityDelta;
+            velocities.speed[i] = std::max(velocities.speed[i] + physics.acceleration[i] * deltaTime, 0.0f);
 
-            positions[i].pos += velocities[i].direction * velocities[i].speed * deltaTime;
+            const float speedResult = velocities.speed[i] * deltaTime;
+            positions.x[i] = previousPositions.x[i] + velocities.directionX[i] * speedResult;
+            positions.y[i] = previousPositions.y[i] + velocities.directionY[i] * speedResult;
         }
     }
 
-    inline void UpdateMotion(std::array<Entity::Position, Entity::numEntities>& positions, std::array<Entity::Velocity, Entity::numEntities>& velocities, std::array<Entity::Physics, Entity::numEntities>& physics)
+#if defined(__x86_64__) || defined(_M_X64) // x64 architecture, every kernel is compiled for its own instruction set and picked at runtime
+    __attribute__((target("sse4.1")))
+    void UpdateMotionSse4(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, const size_t begin, const size_t end, const float deltaTime)
     {
-        Clocks::StartSimClock();
+        const size_t simdWidth = 4;
+        const __m128 zeroFourLane = _mm_set1_ps(0.0f);
+        const __m128 deltaTimeFourLane = _mm_set1_ps(deltaTime);
+        const __m128 gravityDeltaFourLane = _mm_set1_ps(gravity * deltaTime);
 
-        const float deltaTime = Clocks::GetDeltaTime();
-        const float gravityDelta = gravity * deltaTime;
+        size_t i = begin;
+        for (; i + simdWidth <= end; i += simdWidth)
+        {
+            __m128 accel = _mm_load_ps(&physics.acceleration[i]);
+            __m128 speed = _mm_load_ps(&velocities.speed[i]);
+            const __m128 directionX = _mm_load_ps(&velocities.directionX[i]);
+            const __m128 directionY = _mm_load_ps(&velocities.directionY[i]);
+            __m128 posX = _mm_load_ps(&previousPositions.x[i]);
+            __m128 posY = _mm_load_ps(&previousPositions.y[i]);
 
-#ifdef RUN_WITHOUT_SIMD
-        IterateAndUpdateMotionOnRemaining(positions, velocities, physics, 0, gravityDelta);
-#else
+            accel = _mm_sub_ps(accel, gravityDeltaFourLane);
+            speed = _mm_max_ps(_mm_add_ps(speed, _mm_mul_ps(accel, deltaTimeFourLane)), zeroFourLane);
 
-#if defined(__x86_64__) || defined(_M_X64) // x64
+            const __m128 speedResult = _mm_mul_ps(speed, deltaTimeFourLane);
+            const __m128 posXStep = _mm_mul_ps(directionX, speedResult);
+            const __m128 posYStep = _mm_mul_ps(directionY, speedResult);
+
+            posX = _mm_add_ps(posX, posXStep);
+            posY = _mm_add_ps(posY, posYStep);
+
+            _mm_store_ps(&physics.acceleration[i], accel);
+            _mm_store_ps(&velocities.speed[i], speed);
+            _mm_store_ps(&positions.x[i], posX);
+            _mm_store_ps(&positions.y[i], posY);
+        }
+
+        // Whatever doesn't fill up a whole SIMD register.
+        UpdateMotionScalar(previousPositions, positions, velocities, physics, i, end, deltaTime);
+    }
+
+    __attribute__((target("avx2")))
+    void UpdateMotionAvx2(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, const size_t begin, const size_t end, const float deltaTime)
+    {
         const size_t simdWidth = 8;
         const __m256 zeroEightLane = _mm256_set1_ps(0.0f);
         const __m256 deltaTimeEightLane = _mm256_set1_ps(deltaTime);
-        const __m256 gravityDeltaEightLane = _mm256_set1_ps(gravityDelta);
-#elif defined(__arm__) || defined(__aarch64__)
-        const size_t simdWidth = 4;
-        const float32x4_t zeroFourLane = vdupq_n_f32(0.0f);
-        const float32x4_t deltaTimeFourLane = vdupq_n_f32(deltaTime);
-        const float32x4_t gravityDeltaFourLane = vdupq_n_f32(gravityDelta);
-#endif
+        const __m256 gravityDeltaEightLane = _mm256_set1_ps(gravity * deltaTime);
 
-        size_t i = 0;
-        if (Entity::numEntities < simdWidth)
+        size_t i = begin;
+        for (; i + simdWidth <= end; i += simdWidth)
         {
-            goto calculate_out_of_simd_scope_remainders;
-        }
+            __m256 accel = _mm256_load_ps(&physics.acceleration[i]);
+            __m256 speed = _mm256_load_ps(&velocities.speed[i]);
+            const __m256 directionX = _mm256_load_ps(&velocities.directionX[i]);
+            const __m256 directionY = _mm256_load_ps(&velocities.directionY[i]);
+            __m256 posX = _mm256_load_ps(&previousPositions.x[i]);
+            __m256 posY = _mm256_load_ps(&previousPositions.y[i]);
 
-        for (; i < velocities.size(); i += simdWidth)
-        {
-#if defined(__x86_64__) || defined(_M_X64) // x64
-            __m256 accel = _mm256_setzero_ps();
-            __m256 speed = _mm256_setzero_ps();
-            __m256 directionX = _mm256_setzero_ps();
-            __m256 directionY = _mm256_setzero_ps();
-            __m256 posX = _mm256_setzero_ps();
-            __m256 posY = _mm256_setzero_ps();
-#elif defined(__arm__) || defined(__aarch64__)
-            float32x4_t accel = vdupq_n_f32(0.0f);
-            float32x4_t speed = vdupq_n_f32(0.0f);
-            float32x4_t directionX = vdupq_n_f32(0.0f);
-            float32x4_t directionY = vdupq_n_f32(0.0f);
-            float32x4_t posX = vdupq_n_f32(0.0f);
-            float32x4_t posY = vdupq_n_f32(0.0f);
-#endif
-
-#if defined(__x86_64__) || defined(_M_X64) // x64 architecture (AVX)
-            for (int j = 0; j < simdWidth; ++j)
-            {
-                accel = _mm256_set_ps(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, physics[i + j].acceleration);
-                speed = _mm256_set_ps(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, velocities[i + j].speed);
-                directionX = _mm256_set_ps(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, velocities[i + j].direction.x);
-                directionY = _mm256_set_ps(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, velocities[i + j].direction.y);
-                posX = _mm256_set_ps(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, positions[i + j].pos.x);
-                posY = _mm256_set_ps(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, positions[i + j].pos.y);
-            }
-#elif defined(__arm__) || defined(__aarch64__) // ARM architecture (NEON)
-            accel = vsetq_lane_f32(physics[i].acceleration, accel, 0);
-            speed = vsetq_lane_f32(velocities[i].speed, speed, 0);
-            directionX = vsetq_lane_f32(velocities[i].direction.x, directionX, 0);
-            directionY = vsetq_lane_f32(velocities[i].direction.y, directionY, 0);
-            posX = vsetq_lane_f32(positions[i].pos.x, posX, 0);
-            posY = vsetq_lane_f32(positions[i].pos.y, posY, 0);
-
-            accel = vsetq_lane_f32(physics[i + 1].acceleration, accel, 1);
-            speed = vsetq_lane_f32(velocities[i + 1].speed, speed, 1);
-            directionX = vsetq_lane_f32(velocities[i + 1].direction.x, directionX, 1);
-            directionY = vsetq_lane_f32(velocities[i + 1].direction.y, directionY, 1);
-            posX = vsetq_lane_f32(positions[i + 1].pos.x, posX, 1);
-            posY = vsetq_lane_f32(positions[i + 1].pos.y, posY, 1);
-
-            accel = vsetq_lane_f32(physics[i + 2].acceleration, accel, 2);
-            speed = vsetq_lane_f32(velocities[i + 2].speed, speed, 2);
-            directionX = vsetq_lane_f32(velocities[i + 2].direction.x, directionX, 2);
-            directionY = vsetq_lane_f32(velocities[i + 2].direction.y, directionY, 2);
-            posX = vsetq_lane_f32(positions[i + 2].pos.x, posX, 2);
-            posY = vsetq_lane_f32(positions[i + 2].pos.y, posY, 2);
-
-            accel = vsetq_lane_f32(physics[i + 3].acceleration, accel, 3);
-            speed = vsetq_lane_f32(velocities[i + 3].speed, speed, 3);
-            directionX = vsetq_lane_f32(velocities[i + 3].direction.x, directionX, 3);
-            directionY = vsetq_lane_f32(velocities[i + 3].direction.y, directionY, 3);
-            posX = vsetq_lane_f32(positions[i + 3].pos.x, posX, 3);
-            posY = vsetq_lane_f32(positions[i + 3].pos.y, posY, 3);
-#endif
-
-            // Perform SIMD operations
-#if defined(__x86_64__) || defined(_M_X64) // x64
             accel = _mm256_sub_ps(accel, gravityDeltaEightLane);
             speed = _mm256_max_ps(_mm256_add_ps(speed, _mm256_mul_ps(accel, deltaTimeEightLane)), zeroEightLane);
 
@@ -126,7 +112,72 @@ namespace SimulateMotionJob
 
             posX = _mm256_add_ps(posX, posXStep);
             posY = _mm256_add_ps(posY, posYStep);
-#elif defined(__arm__) || defined(__aarch64__) // ARM
+
+            _mm256_store_ps(&physics.acceleration[i], accel);
+            _mm256_store_ps(&velocities.speed[i], speed);
+            _mm256_store_ps(&positions.x[i], posX);
+            _mm256_store_ps(&positions.y[i], posY);
+        }
+
+        // Whatever doesn't fill up a whole SIMD register.
+        UpdateMotionScalar(previousPositions, positions, velocities, physics, i, end, deltaTime);
+    }
+
+    __attribute__((target("avx512f")))
+    void UpdateMotionAvx512(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, const size_t begin, const size_t end, const float deltaTime)
+    {
+        const size_t simdWidth = 16;
+        const __m512 zeroSixteenLane = _mm512_set1_ps(0.0f);
+        const __m512 deltaTimeSixteenLane = _mm512_set1_ps(deltaTime);
+        const __m512 gravityDeltaSixteenLane = _mm512_set1_ps(gravity * deltaTime);
+
+        size_t i = begin;
+        for (; i + simdWidth <= end; i += simdWidth)
+        {
+            __m512 accel = _mm512_load_ps(&physics.acceleration[i]);
+            __m512 speed = _mm512_load_ps(&velocities.speed[i]);
+            const __m512 directionX = _mm512_load_ps(&velocities.directionX[i]);
+            const __m512 directionY = _mm512_load_ps(&velocities.directionY[i]);
+            __m512 posX = _mm512_load_ps(&previousPositions.x[i]);
+            __m512 posY = _mm512_load_ps(&previousPositions.y[i]);
+
+            accel = _mm512_sub_ps(accel, gravityDeltaSixteenLane);
+            speed = _mm512_max_ps(_mm512_add_ps(speed, _mm512_mul_ps(accel, deltaTimeSixteenLane)), zeroSixteenLane);
+
+            const __m512 speedResult = _mm512_mul_ps(speed, deltaTimeSixteenLane);
+            const __m512 posXStep = _mm512_mul_ps(directionX, speedResult);
+            const __m512 posYStep = _mm512_mul_ps(directionY, speedResult);
+
+            posX = _mm512_add_ps(posX, posXStep);
+            posY = _mm512_add_ps(posY, posYStep);
+
+            _mm512_store_ps(&physics.acceleration[i], accel);
+            _mm512_store_ps(&velocities.speed[i], speed);
+            _mm512_store_ps(&positions.x[i], posX);
+            _mm512_store_ps(&positions.y[i], posY);
+        }
+
+        // Whatever doesn't fill up a whole SIMD register.
+        UpdateMotionScalar(previousPositions, positions, velocities, physics, i, end, deltaTime);
+    }
+#elif defined(__arm__) || defined(__aarch64__) // ARM architecture (NEON)
+    void UpdateMotionNeon(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, const size_t begin, const size_t end, const float deltaTime)
+    {
+        const size_t simdWidth = 4;
+        const float32x4_t zeroFourLane = vdupq_n_f32(0.0f);
+        const float32x4_t deltaTimeFourLane = vdupq_n_f32(deltaTime);
+        const float32x4_t gravityDeltaFourLane = vdupq_n_f32(gravity * deltaTime);
+
+        size_t i = begin;
+        for (; i + simdWidth <= end; i += simdWidth)
+        {
+            float32x4_t accel = vld1q_f32(&physics.acceleration[i]);
+            float32x4_t speed = vld1q_f32(&velocities.speed[i]);
+            const float32x4_t directionX = vld1q_f32(&velocities.directionX[i]);
+            const float32x4_t directionY = vld1q_f32(&velocities.directionY[i]);
+            float32x4_t posX = vld1q_f32(&previousPositions.x[i]);
+            float32x4_t posY = vld1q_f32(&previousPositions.y[i]);
+
             accel = vsubq_f32(accel, gravityDeltaFourLane);
             speed = vmaxq_f32(vaddq_f32(speed, vmulq_f32(accel, deltaTimeFourLane)), zeroFourLane);
 
@@ -136,48 +187,148 @@ namespace SimulateMotionJob
 
             posX = vaddq_f32(posX, posXStep);
             posY = vaddq_f32(posY, posYStep);
+
+            vst1q_f32(&physics.acceleration[i], accel);
+            vst1q_f32(&velocities.speed[i], speed);
+            vst1q_f32(&positions.x[i], posX);
+            vst1q_f32(&positions.y[i], posY);
+        }
+
+        // Whatever doesn't fill up a whole SIMD register.
+        UpdateMotionScalar(previousPositions, positions, velocities, physics, i, end, deltaTime);
+    }
 #endif
 
-#if defined(__x86_64__) || defined(_M_X64) // x64
-            for (int j = 0; j < simdWidth; ++j)
+    const std::array<const char*, static_cast<size_t>(MotionKernel::NUM_KERNELS)> kernelNames
+    {
+        "auto",
+        "scalar",
+        "sse4",
+        "avx2",
+        "avx512",
+        "neon"
+    };
+
+    // The widest kernel this CPU can run when asked for AUTO, any other kernel as is.
+    MotionKernel ResolveKernel(const MotionKernel kernel)
+    {
+        if (kernel != MotionKernel::AUTO)
+        {
+            return kernel;
+        }
+
+        for (size_t i = static_cast<size_t>(MotionKernel::NUM_KERNELS) - 1; i > static_cast<size_t>(MotionKernel::AUTO); i--)
+        {
+            if (GetKernelFunction(static_cast<MotionKernel>(i)) != nullptr)
             {
-                positions[i + j].pos.x = _mm256_cvtss_f32(posX);
-                positions[i + j].pos.y = _mm256_cvtss_f32(posY);
-                velocities[i + j].speed = _mm256_cvtss_f32(speed);
-                physics[i + j].acceleration = _mm256_cvtss_f32(accel);
+                return static_cast<MotionKernel>(i);
             }
-#elif defined(__arm__) || defined(__aarch64__) // ARM
-            positions[i].pos.x = vgetq_lane_f32(posX, 0);
-            positions[i].pos.y = vgetq_lane_f32(posY, 0);
-            velocities[i].speed = vgetq_lane_f32(speed, 0);
-            physics[i].acceleration = vgetq_lane_f32(accel, 0);
-
-            positions[i + 1].pos.x = vgetq_lane_f32(posX, 1);
-            positions[i + 1].pos.y = vgetq_lane_f32(posY, 1);
-            velocities[i + 1].speed = vgetq_lane_f32(speed, 1);
-            physics[i + 1].acceleration = vgetq_lane_f32(accel, 1);
-
-            positions[i + 2].pos.x = vgetq_lane_f32(posX, 2);
-            positions[i + 2].pos.y = vgetq_lane_f32(posY, 2);
-            velocities[i + 2].speed = vgetq_lane_f32(speed, 2);
-            physics[i + 2].acceleration = vgetq_lane_f32(accel, 2);
-
-            positions[i + 3].pos.x = vgetq_lane_f32(posX, 3);
-            positions[i + 3].pos.y = vgetq_lane_f32(posY, 3);
-            velocities[i + 3].speed = vgetq_lane_f32(speed, 3);
-            physics[i + 3].acceleration = vgetq_lane_f32(accel, 3);
-#endif
         }
 
-calculate_out_of_simd_scope_remainders:
-        IterateAndUpdateMotionOnRemaining(positions, velocities, physics, i, gravityDelta);
+        return MotionKernel::SCALAR;
+    }
+
+    UpdateMotionFunction GetKernelFunction(const MotionKernel kernel)
+    {
+#if defined(__x86_64__) || defined(_M_X64)
+        // Needed before checking features from a static initializer, which is where the default kernel is picked.
+        __builtin_cpu_init();
 #endif
 
-        Clocks::PauseSimClock();
+        switch (kernel)
+        {
+        case MotionKernel::AUTO:
+            return GetKernelFunction(ResolveKernel(kernel));
+        case MotionKernel::SCALAR:
+            return &UpdateMotionScalar;
+#if defined(__x86_64__) || defined(_M_X64)
+        case MotionKernel::SSE4:
+            return __builtin_cpu_supports("sse4.1") ? &UpdateMotionSse4 : nullptr;
+        case MotionKernel::AVX2:
+            return __builtin_cpu_supports("avx2") ? &UpdateMotionAvx2 : nullptr;
+        case MotionKernel::AVX512:
+            return __builtin_cpu_supports("avx512f") ? &UpdateMotionAvx512 : nullptr;
+#elif defined(__arm__) || defined(__aarch64__)
+        case MotionKernel::NEON:
+            return &UpdateMotionNeon;
+#endif
+        default:
+            return nullptr;
+        }
+    }
+
+    MotionKernel activeKernel = ResolveKernel(MotionKernel::AUTO);
+    UpdateMotionFunction activeFunction = GetKernelFunction(activeKernel);
+
+    const char* GetKernelName(const MotionKernel kernel)
+    {
+        return kernelNames[static_cast<size_t>(kernel)];
+    }
+
+    bool ParseKernelName(const std::string& name, MotionKernel& outKernel)
+    {
+        for (size_t i = 0; i < kernelNames.size(); i++)
+        {
+            if (name == kernelNames[i])
+            {
+                outKernel = static_cast<MotionKernel>(i);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool SetKernel(const MotionKernel kernel)
+    {
+        const MotionKernel resolvedKernel = ResolveKernel(kernel);
+        const UpdateMotionFunction function = GetKernelFunction(resolvedKernel);
+        if (function == nullptr)
+        {
+            return false;
+        }
+
+        activeKernel = resolvedKernel;
+        activeFunction = function;
+        return true;
+    }
+
+    MotionKernel GetKernel()
+    {
+        return activeKernel;
     }
 
-    std::thread* Run(std::array<Entity::Position, Entity::numEntities>& positions, std::array<Entity::Velocity, Entity::numEntities>& velocities, std::array<Entity::Physics, Entity::numEntities>& physics)
+    void UpdateMotion(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, const size_t begin, const size_t end, const float deltaTime)
     {
-        return new std::thread(&UpdateMotion, std::ref(positions), std::ref(velocities), std::ref(physics));
+        activeFunction(previousPositions, positions, velocities, physics, begin, end, deltaTime);
+    }
+
+    void Run(const Entity::Positions& previousPositions, Entity::Positions& positions, SpatialBins& bins, Entity::Velocities& velocities, Entity::Physics& physics,
+        ActiveSet& activeSet, CollisionJob* collisionJob)
+    {
+        Clocks::StartSimClock();
+
+        // Every entity is updated independently of the others, so the chunked result is identical to updating everything on one thread.
+        const float deltaTime = Clocks::GetDeltaTime();
+        JobSystem::ParallelFor(activeSet.GetSimulatedEnd(), grainSize, [&previousPositions, &positions, &bins, &velocities, &physics, deltaTime](const size_t begin, const size_t end)
+        {
+            const PerfCounters::Scope scope(PerfCounters::Job::UPDATE_MOTION);
+            const Trace::Span span("UpdateMotion");
+            UpdateMotion(previousPositions, positions, velocities, physics, begin, end, deltaTime);
+            bins.BinRange(positions, begin, end);
+        });
+
+        if (collisionJob != nullptr)
+        {
+            collisionJob->Run(positions, velocities);
+        }
+
+        {
+            const PerfCounters::Scope scope(PerfCounters::Job::COMPACT);
+            const Trace::Span span("Compact");
+            activeSet.Compact(positions, bins, velocities, physics);
+        }
+
+        Clocks::PauseSimClock();
     }
-}
\ No newline at end of file
+}
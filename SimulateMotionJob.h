@@ -1,11 +1,60 @@
 #pragma once
 
-#include <thread>
-#include <array>
+#include <string>
 
 #include "Entity.h"
+#include "JobSystem.h"
+#include "SpatialBins.h"
+#include "CollisionJob.h"
+#include "ActiveSet.h"
 
 namespace SimulateMotionJob
 {
-    std::thread* Run(std::array<Entity::Position, Entity::numEntities>& positions, std::array<Entity::Velocity, Entity::numEntities>& velocities, std::array<Entity::Physics, Entity::numEntities>& physics);
+    // Entities per chunk when the update is split across cores. 8192 entities touch 192KB across the six component streams, which stays inside a typical L2.
+    constexpr size_t defaultGrainSize = 8192;
+
+    // The grain size is rounded up to whole cache lines of every stream, which is also a multiple of the SIMD width, so no two chunks ever share a cache line.
+    void SetGrainSize(size_t grainSize);
+    size_t GetGrainSize();
+
+    enum class MotionKernel
+    {
+        AUTO, // The widest kernel the CPU supports.
+        SCALAR,
+        SSE4,
+        AVX2,
+        AVX512,
+        NEON,
+
+        NUM_KERNELS
+    };
+
+    using UpdateMotionFunction = void (*)(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, size_t begin, size_t end, float deltaTime);
+
+    // Every kernel for the target architecture is compiled into the binary with its own instruction set, the widest one the CPU supports is picked at startup.
+    // They all do the same operations in the same order without fusing multiplies and adds, so every kernel gives bit identical results.
+    const char* GetKernelName(MotionKernel kernel);
+    bool ParseKernelName(const std::string& name, MotionKernel& outKernel);
+    UpdateMotionFunction GetKernelFunction(MotionKernel kernel); // nullptr when the kernel isn't built for this architecture or the CPU doesn't support it.
+    bool SetKernel(MotionKernel kernel);
+    MotionKernel GetKernel();
+
+    // The motion kernels update the entities in [begin, end). begin has to be a multiple of the SIMD width for the aligned loads.
+    void UpdateMotionScalar(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, size_t begin, size_t end, float deltaTime);
+#if defined(__x86_64__) || defined(_M_X64)
+    void UpdateMotionSse4(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, size_t begin, size_t end, float deltaTime);
+    void UpdateMotionAvx2(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, size_t begin, size_t end, float deltaTime);
+    void UpdateMotionAvx512(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, size_t begin, size_t end, float deltaTime);
+#elif defined(__arm__) || defined(__aarch64__)
+    void UpdateMotionNeon(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, size_t begin, size_t end, float deltaTime);
+#endif
+    // Runs the kernel picked by SetKernel.
+    void UpdateMotion(const Entity::Positions& previousPositions, Entity::Positions& positions, Entity::Velocities& velocities, Entity::Physics& physics, size_t begin, size_t end, float deltaTime);
+
+    // Reads last frame's positions from previousPositions and writes the moved ones to positions, the two must not be the same buffer.
+    // Every chunk is binned right after it has been moved, the bins have to be created with the current grain size.
+    // Only the entities up to the active set's simulated end are moved, the ones behind it are at rest and positions already holds them.
+    // Collisions are resolved once every entity has moved, unless collisionJob is nullptr, and then the active set is compacted. Runs across all workers and returns when done.
+    void Run(const Entity::Positions& previousPositions, Entity::Positions& positions, SpatialBins& bins, Entity::Velocities& velocities, Entity::Physics& physics,
+        ActiveSet& activeSet, CollisionJob* collisionJob);
 }
@@ -0,0 +1,221 @@
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <vector>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+enum SnapshotStream
+{
+    POSITION_X,
+    POSITION_Y,
+    SPEED,
+    DIRECTION_X,
+    DIRECTION_Y,
+    ACCELERATION,
+    NUM_STREAMS
+};
+
+constexpr std::array<char, 8> magic{ 'M', 'T', 'D', 'O', 'S', 'N', 'A', 'P' };
+
+// Stored as is, so a snapshot only loads on machines with the same byte order as the one that wrote it. The magic catches the mismatch.
+struct Snapshot::Header
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t numStreams;
+    uint64_t numEntities;
+    uint64_t seed;
+    uint64_t frameIndex;
+    double simulatedTime;
+    std::array<uint64_t, NUM_STREAMS> streamOffsets;
+};
+
+size_t RoundUpToPage(const size_t size)
+{
+    return (size + Snapshot::pageSize - 1) / Snapshot::pageSize * Snapshot::pageSize;
+}
+
+bool Snapshot::Save(const std::string& path, const Entity::Positions& positions, const Entity::Velocities& velocities, const Entity::Physics& physics,
+    const std::span<const uint32_t> entityIds, const uint64_t seed, const uint64_t frameIndex, const double simulatedTime)
+{
+    const std::array<std::span<const float>, NUM_STREAMS> streams{ positions.x, positions.y, velocities.speed, velocities.directionX, velocities.directionY, physics.acceleration };
+    const size_t numEntities = positions.x.size();
+    const size_t streamSize = RoundUpToPage(numEntities * sizeof(float));
+    static_assert(sizeof(Header) <= pageSize);
+
+    Header header{};
+    header.magic = magic;
+    header.version = version;
+    header.numStreams = NUM_STREAMS;
+    header.numEntities = numEntities;
+    header.seed = seed;
+    header.frameIndex = frameIndex;
+    header.simulatedTime = simulatedTime;
+    for (size_t stream = 0; stream < NUM_STREAMS; stream++)
+    {
+        header.streamOffsets[stream] = pageSize + stream * streamSize;
+    }
+
+    // Write next to the target and rename it over at the end, a failed save never leaves a broken snapshot behind.
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        const std::vector<char> padding(pageSize, 0);
+        std::vector<uint32_t> slots(numEntities);
+        std::iota(slots.begin(), slots.end(), 0);
+        std::sort(slots.begin(), slots.end(), [entityIds](const uint32_t first, const uint32_t second)
+        {
+            return entityIds[first] < entityIds[second];
+        });
+        std::vector<float> ordered(numEntities);
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(padding.data(), static_cast<std::streamsize>(pageSize - sizeof(Header)));
+        for (const std::span<const float> stream : streams)
+        {
+            for (size_t i = 0; i < numEntities; i++)
+            {
+                ordered[i] = stream[slots[i]];
+            }
+
+            const size_t bytes = stream.size_bytes();
+            file.write(reinterpret_cast<const char*>(ordered.data()), static_cast<std::streamsize>(bytes));
+            file.write(padding.data(), static_cast<std::streamsize>(streamSize - bytes));
+        }
+
+        if (!file.good())
+        {
+            std::cerr << "Could not write snapshot: " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+    {
+        std::cerr << "Could not write snapshot: " << path << " (" << error.message() << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+Snapshot::~Snapshot()
+{
+    if (memory != nullptr)
+    {
+        munmap(memory, size);
+    }
+}
+
+bool Snapshot::Open(const std::string& path)
+{
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file == -1)
+    {
+        std::cerr << "Could not open snapshot: " << path << std::endl;
+        return false;
+    }
+
+    struct stat status{};
+    void* mapped = MAP_FAILED;
+    if (fstat(file, &status) == 0 && static_cast<size_t>(status.st_size) >= pageSize)
+    {
+        size = static_cast<size_t>(status.st_size);
+        mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    }
+
+    // The mapping keeps its own reference to the file.
+    close(file);
+
+    if (mapped == MAP_FAILED)
+    {
+        std::cerr << "Could not map snapshot: " << path << std::endl;
+        return false;
+    }
+
+    memory = static_cast<std::byte*>(mapped);
+
+    const Header& header = GetHeader();
+    bool isValid = header.magic == magic && header.version == version && header.numStreams == NUM_STREAMS && header.numEntities > 0;
+    for (size_t stream = 0; isValid && stream < NUM_STREAMS; stream++)
+    {
+        const uint64_t offset = header.streamOffsets[stream];
+        isValid = offset % pageSize == 0 && offset >= pageSize && offset <= size && (size - offset) / sizeof(float) >= header.numEntities;
+    }
+
+    if (!isValid)
+    {
+        std::cerr << "Not a version " << version << " snapshot: " << path << std::endl;
+        munmap(memory, size);
+        memory = nullptr;
+        return false;
+    }
+
+#ifdef MADV_WILLNEED
+    // Pages are still only read on first touch, this starts reading them in the background so the first frame doesn't wait on every one of them.
+    madvise(memory, size, MADV_WILLNEED);
+#endif
+
+    return true;
+}
+
+bool Snapshot::IsOpen() const
+{
+    return memory != nullptr;
+}
+
+size_t Snapshot::GetNumEntities() const
+{
+    return GetHeader().numEntities;
+}
+
+uint64_t Snapshot::GetSeed() const
+{
+    return GetHeader().seed;
+}
+
+uint64_t Snapshot::GetFrameIndex() const
+{
+    return GetHeader().frameIndex;
+}
+
+double Snapshot::GetSimulatedTime() const
+{
+    return GetHeader().simulatedTime;
+}
+
+Entity::Positions Snapshot::GetPositions() const
+{
+    return Entity::Positions{ GetStream(POSITION_X), GetStream(POSITION_Y) };
+}
+
+Entity::Velocities Snapshot::GetVelocities() const
+{
+    return Entity::Velocities{ GetStream(SPEED), GetStream(DIRECTION_X), GetStream(DIRECTION_Y) };
+}
+
+Entity::Physics Snapshot::GetPhysics() const
+{
+    return Entity::Physics{ GetStream(ACCELERATION) };
+}
+
+std::span<float> Snapshot::GetStream(const size_t stream) const
+{
+    const Header& header = GetHeader();
+    return std::span<float>(reinterpret_cast<float*>(memory + header.streamOffsets[stream]), header.numEntities);
+}
+
+const Snapshot::Header& Snapshot::GetHeader() const
+{
+    return *reinterpret_cast<const Header*>(memory);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Entity.h"
+
+// The whole world saved to a binary file: a header page followed by every component stream, each starting on a page boundary.
+// Opening a snapshot maps the file copy on write, the streams are used in place and the simulation writing to them never changes the file.
+class Snapshot
+{
+public:
+    static constexpr uint32_t version = 1;
+
+    // Offsets in the file are multiples of this, which keeps every mapped stream aligned for the SIMD kernels on any page size.
+    static constexpr size_t pageSize = 4096;
+
+    // Entity entityIds[i] is in slot i of the streams, the file always stores entities in order of their ids.
+    // Despawned entities leave gaps in the ids, the file leaves them out, so the entities of a loaded snapshot are numbered from zero again.
+    static bool Save(const std::string& path, const Entity::Positions& positions, const Entity::Velocities& velocities, const Entity::Physics& physics,
+        std::span<const uint32_t> entityIds, uint64_t seed, uint64_t frameIndex, double simulatedTime);
+
+    Snapshot() = default;
+    ~Snapshot();
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    bool Open(const std::string& path);
+    bool IsOpen() const;
+
+    size_t GetNumEntities() const;
+    uint64_t GetSeed() const;
+    uint64_t GetFrameIndex() const;
+    double GetSimulatedTime() const;
+
+    Entity::Positions GetPositions() const;
+    Entity::Velocities GetVelocities() const;
+    Entity::Physics GetPhysics() const;
+
+private:
+    struct Header;
+
+    std::span<float> GetStream(size_t stream) const;
+    const Header& GetHeader() const;
+
+    std::byte* memory = nullptr;
+    size_t size = 0;
+};
@@ -0,0 +1,159 @@
+#include "SpatialBins.h"
+
+#include <array>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+constexpr uint8_t outsideBin = SpatialBins::maxBins;
+
+size_t CountBins(const float min, const float max, const float binSize)
+{
+    return static_cast<size_t>(std::ceil((max - min) / binSize));
+}
+
+SpatialBins::SpatialBins(Arena& arena, const size_t numEntities, const size_t chunkSizeIn, const Bounds& binnedAreaIn, const float binWidthIn, const float binHeightIn)
+    : binnedArea(binnedAreaIn), binWidth(binWidthIn), binHeight(binHeightIn), chunkSize(chunkSizeIn)
+{
+    inverseBinWidth = 1.0f / binWidth;
+    inverseBinHeight = 1.0f / binHeight;
+    numBinsX = CountBins(binnedArea.minX, binnedArea.maxX, binWidth);
+    numBinsY = CountBins(binnedArea.minY, binnedArea.maxY, binHeight);
+    assert(numBinsX * numBinsY <= maxBins);
+
+    numChunks = (numEntities + chunkSize - 1) / chunkSize;
+
+    indices = Entity::AllocateStream<uint32_t>(arena, numEntities);
+    entityBins = Entity::AllocateStream<uint8_t>(arena, numEntities);
+    binOffsets = Entity::AllocateStream<uint32_t>(arena, numChunks * (GetNumBins() + 1));
+    std::fill(binOffsets.begin(), binOffsets.end(), 0);
+    isSorted = Entity::AllocateStream<uint8_t>(arena, numChunks);
+    std::fill(isSorted.begin(), isSorted.end(), 0);
+}
+
+void SpatialBins::BinRange(const Entity::Positions& positions, const size_t begin, const size_t end)
+{
+    assert(begin % chunkSize == 0);
+
+    // Bins are shifted up by one and clamped to one past either end before truncating, so anything outside lands on 0 or numBins + 1 without overflowing.
+    // Everything is pulled into locals first, the byte stores could alias any of it and would keep the loop from vectorizing.
+    const float* positionsX = positions.x.data();
+    const float* positionsY = positions.y.data();
+    uint8_t* bins = entityBins.data();
+    const float offsetX = 1.0f - binnedArea.minX * inverseBinWidth;
+    const float offsetY = 1.0f - binnedArea.minY * inverseBinHeight;
+    const float scaleX = inverseBinWidth;
+    const float scaleY = inverseBinHeight;
+    const float maxShiftedX = static_cast<float>(numBinsX + 1);
+    const float maxShiftedY = static_cast<float>(numBinsY + 1);
+    const int32_t numColumns = static_cast<int32_t>(numBinsX);
+    const int32_t numRows = static_cast<int32_t>(numBinsY);
+    for (size_t i = begin; i < end; i++)
+    {
+        const float unclampedX = positionsX[i] * scaleX + offsetX;
+        const float unclampedY = positionsY[i] * scaleY + offsetY;
+        const int32_t shiftedX = static_cast<int32_t>(unclampedX < 0.0f ? 0.0f : (unclampedX > maxShiftedX ? maxShiftedX : unclampedX));
+        const int32_t shiftedY = static_cast<int32_t>(unclampedY < 0.0f ? 0.0f : (unclampedY > maxShiftedY ? maxShiftedY : unclampedY));
+        const bool isInside = (shiftedX >= 1) & (shiftedX <= numColumns) & (shiftedY >= 1) & (shiftedY <= numRows);
+        bins[i] = isInside ? static_cast<uint8_t>((shiftedY - 1) * numColumns + shiftedX - 1) : outsideBin;
+    }
+
+    std::array<uint32_t, maxBins + 1> counts{};
+    for (size_t i = begin; i < end; i++)
+    {
+        counts[entityBins[i]]++;
+    }
+
+    // Counting sort within the chunk, the outside bin is counted but never stored.
+    const size_t numBins = GetNumBins();
+    uint32_t* chunkOffsets = &binOffsets[begin / chunkSize * (numBins + 1)];
+    std::array<uint32_t, maxBins + 1> writeOffsets;
+    uint32_t offset = 0;
+    for (size_t bin = 0; bin < numBins; bin++)
+    {
+        chunkOffsets[bin] = offset;
+        writeOffsets[bin] = offset;
+        offset += counts[bin];
+    }
+    chunkOffsets[numBins] = offset;
+
+    // Gathering entities bin by bin costs about twice as much per entity as streaming through the chunk, so unless enough of them can be skipped don't spend time sorting it.
+    isSorted[begin / chunkSize] = offset <= (end - begin) / 2;
+    if (!isSorted[begin / chunkSize])
+    {
+        return;
+    }
+
+    uint32_t* chunkIndices = &indices[begin];
+    for (size_t i = begin; i < end; i++)
+    {
+        const uint8_t bin = entityBins[i];
+        if (bin != outsideBin)
+        {
+            chunkIndices[writeOffsets[bin]++] = static_cast<uint32_t>(i);
+        }
+    }
+}
+
+void SpatialBins::BinAll(const Entity::Positions& positions)
+{
+    const size_t numEntities = positions.x.size();
+    for (size_t begin = 0; begin < numEntities; begin += chunkSize)
+    {
+        BinRange(positions, begin, std::min(begin + chunkSize, numEntities));
+    }
+}
+
+void SpatialBins::CopyChunk(const SpatialBins& source, const size_t chunk)
+{
+    const size_t numOffsets = GetNumBins() + 1;
+    const uint32_t* sourceOffsets = &source.binOffsets[chunk * numOffsets];
+    std::copy(sourceOffsets, sourceOffsets + numOffsets, &binOffsets[chunk * numOffsets]);
+    isSorted[chunk] = source.isSorted[chunk];
+    if (isSorted[chunk] != 0)
+    {
+        const uint32_t* sourceIndices = &source.indices[chunk * chunkSize];
+        std::copy(sourceIndices, sourceIndices + sourceOffsets[numOffsets - 1], &indices[chunk * chunkSize]);
+    }
+}
+
+bool SpatialBins::IsSorted(const size_t chunk) const
+{
+    return isSorted[chunk] != 0;
+}
+
+size_t SpatialBins::GetChunkSize() const
+{
+    return chunkSize;
+}
+
+size_t SpatialBins::GetNumChunks() const
+{
+    return numChunks;
+}
+
+size_t SpatialBins::GetArenaBytes(const size_t numEntities, const size_t chunkSize, const Bounds& binnedArea, const float binWidth, const float binHeight)
+{
+    const size_t numBins = CountBins(binnedArea.minX, binnedArea.maxX, binWidth) * CountBins(binnedArea.minY, binnedArea.maxY, binHeight);
+    const size_t numChunks = (numEntities + chunkSize - 1) / chunkSize;
+    return Entity::GetStreamBytes<uint32_t>(numEntities) + Entity::GetStreamBytes<uint8_t>(numEntities)
+        + Entity::GetStreamBytes<uint32_t>(numChunks * (numBins + 1)) + Entity::GetStreamBytes<uint8_t>(numChunks);
+}
+
+size_t SpatialBins::GetNumBins() const
+{
+    return numBinsX * numBinsY;
+}
+
+bool SpatialBins::Overlaps(const size_t bin, const Bounds& bounds) const
+{
+    const float minX = binnedArea.minX + static_cast<float>(bin % numBinsX) * binWidth;
+    const float minY = binnedArea.minY + static_cast<float>(bin / numBinsX) * binHeight;
+    return minX < bounds.maxX && minX + binWidth > bounds.minX && minY < bounds.maxY && minY + binHeight > bounds.minY;
+}
+
+std::span<const uint32_t> SpatialBins::GetIndices(const size_t chunk, const size_t bin) const
+{
+    const uint32_t* chunkOffsets = &binOffsets[chunk * (GetNumBins() + 1)];
+    return std::span<const uint32_t>(&indices[chunk * chunkSize + chunkOffsets[bin]], chunkOffsets[bin + 1] - chunkOffsets[bin]);
+}
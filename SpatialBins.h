@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "Entity.h"
+#include "Arena.h"
+
+// Entity indices bucketed into coarse tiles of an area of the world, rebuilt by the simulation chunk by chunk while the positions it just wrote are still in cache.
+// Entities outside the binned area are left out, so walking the bins only ever touches entities inside it.
+// Within a bin of a chunk the indices are in ascending order. As long as bin edges line up with whatever the positions get mapped to, like console cells,
+// two entities that end up in the same place are always in the same bin, so walking the bins chunk by chunk keeps their order.
+// Only holds views into arena memory and can be copied around freely.
+class SpatialBins
+{
+public:
+    struct Bounds
+    {
+        float minX;
+        float minY;
+        float maxX;
+        float maxY;
+    };
+
+    static constexpr size_t maxBins = 255;
+
+    // The binned area is covered by bins of the given size starting at its min corner, the last row and column of bins may reach past it.
+    SpatialBins(Arena& arena, size_t numEntities, size_t chunkSize, const Bounds& binnedArea, float binWidth, float binHeight);
+
+    // Arena memory the bins take, an index and a bin per entity and the offsets of every bin and a flag per chunk. More chunks of fewer entities take more of it.
+    static size_t GetArenaBytes(size_t numEntities, size_t chunkSize, const Bounds& binnedArea, float binWidth, float binHeight);
+
+    // Rebuilds the bins of the chunk that starts at begin, begin has to be a multiple of the chunk size.
+    void BinRange(const Entity::Positions& positions, size_t begin, size_t end);
+    void BinAll(const Entity::Positions& positions);
+
+    // Copies the bins of one chunk from bins made with the same size, area and chunk size, for positions that were copied along with them.
+    void CopyChunk(const SpatialBins& source, size_t chunk);
+
+    // A chunk's indices are only sorted into bins when at least half of its entities are outside the binned area, otherwise it should be walked as a range.
+    bool IsSorted(size_t chunk) const;
+    size_t GetChunkSize() const;
+    size_t GetNumChunks() const;
+    size_t GetNumBins() const;
+    bool Overlaps(size_t bin, const Bounds& bounds) const;
+    std::span<const uint32_t> GetIndices(size_t chunk, size_t bin) const;
+
+private:
+    Bounds binnedArea;
+    float binWidth;
+    float binHeight;
+    float inverseBinWidth;
+    float inverseBinHeight;
+    size_t numBinsX;
+    size_t numBinsY;
+    size_t chunkSize;
+    size_t numChunks;
+
+    std::span<uint32_t> indices; // Every chunk's binned entities, bin by bin, starting at the chunk's first entity.
+    std::span<uint8_t> entityBins; // Scratch space for the bin of every entity between the two binning passes.
+    std::span<uint32_t> binOffsets; // numBins + 1 offsets per chunk into its part of indices.
+    std::span<uint8_t> isSorted;
+};
@@ -0,0 +1,258 @@
+#include "SpatialGrid.h"
+
+#include <bit>
+
+#include "JobSystem.h"
+
+constexpr size_t grainSize = 16384;
+
+// The first pass of the sort splits entities into this many partitions by the top bits of their bucket.
+constexpr uint32_t maxPartitionBits = 8;
+
+SpatialGrid::SpatialGrid(Arena& arena, const size_t numEntities, const float cellSizeIn)
+    : cellSize(cellSizeIn), inverseCellSize(1.0f / cellSizeIn), numChunks(0), numSorted(0)
+{
+    const size_t numBuckets = CountBuckets(numEntities);
+    const uint32_t bucketBits = static_cast<uint32_t>(std::countr_zero(numBuckets));
+    bucketMask = numBuckets - 1;
+    bucketsPerRow = size_t{1} << ((bucketBits + 1) / 2);
+    partitionShift = bucketBits - std::min(bucketBits, maxPartitionBits);
+    const size_t maxNumChunks = (numEntities + grainSize - 1) / grainSize;
+
+    entityBuckets = Entity::AllocateStream<uint32_t>(arena, numEntities);
+    partitionedIndices = Entity::AllocateStream<uint32_t>(arena, numEntities);
+    partitionedBuckets = Entity::AllocateStream<uint32_t>(arena, numEntities);
+    partitionedX = Entity::AllocateStream<float>(arena, numEntities);
+    partitionedY = Entity::AllocateStream<float>(arena, numEntities);
+    chunkOffsets = Entity::AllocateStream<uint32_t>(arena, maxNumChunks * GetNumPartitions());
+    partitionOffsets = Entity::AllocateStream<uint32_t>(arena, GetNumPartitions() + 1);
+    bucketOffsets = Entity::AllocateStream<uint32_t>(arena, numBuckets + 1);
+    std::fill(bucketOffsets.begin(), bucketOffsets.end(), 0);
+    bucketCursors = Entity::AllocateStream<uint32_t>(arena, numBuckets);
+    sortedIndices = Entity::AllocateStream<uint32_t>(arena, numEntities);
+    sortedX = Entity::AllocateStream<float>(arena, numEntities);
+    sortedY = Entity::AllocateStream<float>(arena, numEntities);
+}
+
+size_t SpatialGrid::GetArenaBytes(const size_t numEntities)
+{
+    const size_t numBuckets = CountBuckets(numEntities);
+    const size_t numPartitions = size_t{1} << std::min(static_cast<uint32_t>(std::countr_zero(numBuckets)), maxPartitionBits);
+    const size_t maxNumChunks = (numEntities + grainSize - 1) / grainSize;
+    return 3 * Entity::GetStreamBytes<uint32_t>(numEntities) + 2 * Entity::GetStreamBytes<float>(numEntities)
+        + Entity::GetStreamBytes<uint32_t>(maxNumChunks * numPartitions) + Entity::GetStreamBytes<uint32_t>(numPartitions + 1)
+        + Entity::GetStreamBytes<uint32_t>(numBuckets + 1) + Entity::GetStreamBytes<uint32_t>(numBuckets)
+        + Entity::GetStreamBytes<uint32_t>(numEntities) + 2 * Entity::GetStreamBytes<float>(numEntities);
+}
+
+// Two pass counting sort, both passes stable so every bucket ends up in ascending index order.
+// Sorting straight into a bucket per entity would scatter every entity to a random place in a table as big as the world, with the counts shared between workers.
+// Partitioning first keeps the counts per chunk and the writes to a few hundred streams, and each partition is then small enough to sort into its buckets in cache.
+void SpatialGrid::Build(const Entity::Positions& positions)
+{
+    const size_t numEntities = positions.x.size();
+    const size_t numPartitions = GetNumPartitions();
+    numChunks = (numEntities + grainSize - 1) / grainSize;
+    numSorted = numEntities;
+
+    JobSystem::ParallelFor(numEntities, grainSize, [this, &positions, numPartitions](const size_t begin, const size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            entityBuckets[i] = static_cast<uint32_t>(GetBucket(GetCellCoordinate(positions.x[i]), GetCellCoordinate(positions.y[i])));
+        }
+
+        uint32_t* counts = &chunkOffsets[begin / grainSize * numPartitions];
+        std::fill(counts, counts + numPartitions, 0);
+        for (size_t i = begin; i < end; i++)
+        {
+            counts[entityBuckets[i] >> partitionShift]++;
+        }
+    });
+
+    // Partition by partition and chunk by chunk, turns the counts into where every chunk writes its part of every partition.
+    uint32_t offset = 0;
+    for (size_t partition = 0; partition < numPartitions; partition++)
+    {
+        partitionOffsets[partition] = offset;
+        for (size_t chunk = 0; chunk < numChunks; chunk++)
+        {
+            const uint32_t count = chunkOffsets[chunk * numPartitions + partition];
+            chunkOffsets[chunk * numPartitions + partition] = offset;
+            offset += count;
+        }
+    }
+    partitionOffsets[numPartitions] = offset;
+
+    // Positions are carried along while they are read in order, gathering them later would sweep all of them once per partition.
+    JobSystem::ParallelFor(numEntities, grainSize, [this, &positions, numPartitions](const size_t begin, const size_t end)
+    {
+        uint32_t* cursors = &chunkOffsets[begin / grainSize * numPartitions];
+        for (size_t i = begin; i < end; i++)
+        {
+            const uint32_t partitioned = cursors[entityBuckets[i] >> partitionShift]++;
+            partitionedIndices[partitioned] = static_cast<uint32_t>(i);
+            partitionedBuckets[partitioned] = entityBuckets[i];
+            partitionedX[partitioned] = positions.x[i];
+            partitionedY[partitioned] = positions.y[i];
+        }
+    });
+
+    // Every partition owns a contiguous range of buckets and of the sorted streams, so partitions sort independently of each other.
+    const size_t bucketsPerPartition = size_t{1} << partitionShift;
+    JobSystem::ParallelFor(numPartitions, 1, [this, bucketsPerPartition](const size_t beginPartition, const size_t endPartition)
+    {
+        for (size_t partition = beginPartition; partition < endPartition; partition++)
+        {
+            const size_t firstBucket = partition * bucketsPerPartition;
+            const uint32_t partitionBegin = partitionOffsets[partition];
+            const uint32_t partitionEnd = partitionOffsets[partition + 1];
+
+            std::fill(bucketCursors.begin() + firstBucket, bucketCursors.begin() + firstBucket + bucketsPerPartition, 0);
+            for (uint32_t i = partitionBegin; i < partitionEnd; i++)
+            {
+                bucketCursors[partitionedBuckets[i]]++;
+            }
+
+            uint32_t bucketOffset = partitionBegin;
+            for (size_t bucket = firstBucket; bucket < firstBucket + bucketsPerPartition; bucket++)
+            {
+                const uint32_t count = bucketCursors[bucket];
+                bucketOffsets[bucket] = bucketOffset;
+                bucketCursors[bucket] = bucketOffset;
+                bucketOffset += count;
+            }
+
+            for (uint32_t i = partitionBegin; i < partitionEnd; i++)
+            {
+                const uint32_t sorted = bucketCursors[partitionedBuckets[i]]++;
+                sortedIndices[sorted] = partitionedIndices[i];
+                sortedX[sorted] = partitionedX[i];
+                sortedY[sorted] = partitionedY[i];
+            }
+        }
+    });
+    bucketOffsets[GetNumBuckets()] = static_cast<uint32_t>(numEntities);
+}
+
+float SpatialGrid::GetCellSize() const
+{
+    return cellSize;
+}
+
+size_t SpatialGrid::GetNumBuckets() const
+{
+    return bucketMask + 1;
+}
+
+size_t SpatialGrid::GetNumPartitions() const
+{
+    return GetNumBuckets() >> partitionShift;
+}
+
+size_t SpatialGrid::CountBuckets(const size_t numEntities)
+{
+    return std::bit_ceil(std::max<size_t>(numEntities, minNumBuckets));
+}
+
+std::span<const uint32_t> SpatialGrid::GetSortedIndices() const
+{
+    return sortedIndices.first(numSorted);
+}
+
+std::span<const float> SpatialGrid::GetSortedX() const
+{
+    return sortedX.first(numSorted);
+}
+
+std::span<const float> SpatialGrid::GetSortedY() const
+{
+    return sortedY.first(numSorted);
+}
+
+uint32_t SpatialGrid::GetBucketBegin(const size_t bucket) const
+{
+    return bucketOffsets[bucket];
+}
+
+uint32_t SpatialGrid::GetBucketEnd(const size_t bucket) const
+{
+    return bucketOffsets[bucket + 1];
+}
+
+size_t SpatialGrid::FindNearest(const float x, const float y, const float maxRadius, const std::span<uint32_t> outIndices, const std::span<float> outDistancesSquared) const
+{
+    const size_t maxFound = std::min(outIndices.size(), outDistancesSquared.size());
+    if (maxFound == 0)
+    {
+        return 0;
+    }
+
+    const float maxRadiusSquared = maxRadius * maxRadius;
+    const int32_t centerX = GetCellCoordinate(x);
+    const int32_t centerY = GetCellCoordinate(y);
+
+    // How far the point is from the nearest edge of its own cell, every ring is that much further away than a whole number of cells.
+    const float localX = x - static_cast<float>(centerX) * cellSize;
+    const float localY = y - static_cast<float>(centerY) * cellSize;
+    const float nearestEdge = std::max(std::min(std::min(localX, cellSize - localX), std::min(localY, cellSize - localY)), 0.0f);
+    const int32_t maxRing = GetCellCoordinate(maxRadius) + 1;
+    size_t numFound = 0;
+
+    // Keeps the closest entities found so far sorted by distance, ties go to the lower index so the result doesn't depend on the visiting order.
+    auto insert = [&](const uint32_t sorted)
+    {
+        const float deltaX = sortedX[sorted] - x;
+        const float deltaY = sortedY[sorted] - y;
+        const float distanceSquared = deltaX * deltaX + deltaY * deltaY;
+        const uint32_t index = sortedIndices[sorted];
+        if (distanceSquared > maxRadiusSquared)
+        {
+            return;
+        }
+
+        size_t position = numFound;
+        while (position > 0 && (outDistancesSquared[position - 1] > distanceSquared || (outDistancesSquared[position - 1] == distanceSquared && outIndices[position - 1] > index)))
+        {
+            if (position < maxFound)
+            {
+                outIndices[position] = outIndices[position - 1];
+                outDistancesSquared[position] = outDistancesSquared[position - 1];
+            }
+            position--;
+        }
+
+        if (position < maxFound)
+        {
+            outIndices[position] = index;
+            outDistancesSquared[position] = distanceSquared;
+            numFound = std::min(numFound + 1, maxFound);
+        }
+    };
+
+    // Walks square rings of cells outwards from the point's cell. Once the next ring is further away than the furthest entity kept, nothing closer is left.
+    for (int32_t ring = 0; ring <= maxRing; ring++)
+    {
+        const float ringDistance = static_cast<float>(ring - 1) * cellSize + nearestEdge;
+        if (ring > 0 && ringDistance > maxRadius)
+        {
+            break;
+        }
+
+        if (numFound == maxFound && ring > 0 && ringDistance * ringDistance >= outDistancesSquared[maxFound - 1])
+        {
+            break;
+        }
+
+        for (int32_t cellY = centerY - ring; cellY <= centerY + ring; cellY++)
+        {
+            const bool isEdgeRow = cellY == centerY - ring || cellY == centerY + ring;
+            for (int32_t cellX = centerX - ring; cellX <= centerX + ring; cellX += isEdgeRow || ring == 0 ? 1 : 2 * ring)
+            {
+                ForEachInCell(cellX, cellY, insert);
+            }
+        }
+    }
+
+    return numFound;
+}
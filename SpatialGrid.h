@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "Entity.h"
+#include "Arena.h"
+
+// Every entity sorted into square cells of a uniform grid that covers the whole plane, for finding the entities near a point without looking at all of them.
+// The grid has no bounds, cells are wrapped around onto a fixed window of buckets instead. A bucket can hold entities of more than one cell, queries check the cell of every entity they look at.
+// Cells next to each other in a row are in neighbouring buckets and rows are a fixed stride apart, so walking the buckets in order walks the plane and neighbours stay close in memory.
+// Rebuilt from scratch with a parallel counting sort, within a bucket the entities are in ascending index order so every build of the same positions gives the same grid.
+// Only holds views into arena memory and can be copied around freely.
+class SpatialGrid
+{
+public:
+    static constexpr size_t minNumBuckets = 64;
+
+    SpatialGrid(Arena& arena, size_t numEntities, float cellSize);
+
+    static size_t GetArenaBytes(size_t numEntities);
+
+    // Runs across all workers through JobSystem::ParallelFor and returns when the grid is complete.
+    // Sorts every entity in positions, which can be fewer than the grid was made for but never more.
+    void Build(const Entity::Positions& positions);
+
+    float GetCellSize() const;
+    size_t GetNumBuckets() const;
+
+    // Views of the sorted entities, every bucket's entities are stored next to each other. The positions are copies taken by Build.
+    std::span<const uint32_t> GetSortedIndices() const;
+    std::span<const float> GetSortedX() const;
+    std::span<const float> GetSortedY() const;
+    uint32_t GetBucketBegin(size_t bucket) const;
+    uint32_t GetBucketEnd(size_t bucket) const;
+
+    int32_t GetCellCoordinate(float position) const;
+    size_t GetBucket(int32_t cellX, int32_t cellY) const;
+
+    // The bucket offsetX cells to the side and offsetY rows away from bucket. Buckets wrap the same way cells do, so for every cell in bucket, that is where its neighbour is.
+    size_t GetNeighbourBucket(size_t bucket, int32_t offsetX, int32_t offsetY) const;
+
+    // Calls function(index, distanceSquared) for every entity within radius of the point. Entities are visited cell by cell, not by distance.
+    template<typename Function>
+    void ForEachInRadius(float x, float y, float radius, const Function& function) const;
+
+    // Finds up to outIndices.size() entities closest to the point but no further away than maxRadius, nearest first. Returns how many were found.
+    // An entity sitting at the point is found as well, callers looking for the neighbours of an entity have to skip it.
+    size_t FindNearest(float x, float y, float maxRadius, std::span<uint32_t> outIndices, std::span<float> outDistancesSquared) const;
+
+private:
+    template<typename Function>
+    void ForEachInCell(int32_t cellX, int32_t cellY, const Function& function) const;
+
+    size_t GetNumPartitions() const;
+
+    // About one bucket per entity keeps buckets short without spending much memory on empty ones.
+    // Never fewer than 8x8, so the 3x3 cells around any cell are always in different buckets.
+    static size_t CountBuckets(size_t numEntities);
+
+    float cellSize;
+    float inverseCellSize;
+    size_t bucketMask;
+    size_t bucketsPerRow;
+    uint32_t partitionShift; // Bucket bits below the partition bits.
+    size_t numChunks; // Of the last build.
+    size_t numSorted;
+
+    // Scratch space for the sort.
+    std::span<uint32_t> entityBuckets;
+    std::span<uint32_t> partitionedIndices;
+    std::span<uint32_t> partitionedBuckets;
+    std::span<float> partitionedX;
+    std::span<float> partitionedY;
+    std::span<uint32_t> chunkOffsets; // numPartitions counts, and then offsets, per chunk of entities.
+    std::span<uint32_t> partitionOffsets;
+    std::span<uint32_t> bucketCursors;
+
+    std::span<uint32_t> bucketOffsets; // numBuckets + 1 offsets into the sorted streams.
+    std::span<uint32_t> sortedIndices;
+    std::span<float> sortedX;
+    std::span<float> sortedY;
+};
+
+inline int32_t SpatialGrid::GetCellCoordinate(const float position) const
+{
+    // Floors by truncating and stepping down for negatives, which vectorizes where std::floor doesn't. Clamped well inside int32 so neighbouring cells never overflow.
+    const float scaled = std::clamp(position * inverseCellSize, -1073741824.0f, 1073741824.0f);
+    const int32_t truncated = static_cast<int32_t>(scaled);
+    return truncated - (scaled < static_cast<float>(truncated) ? 1 : 0);
+}
+
+inline size_t SpatialGrid::GetBucket(const int32_t cellX, const int32_t cellY) const
+{
+    // Row major index of the cell in a window of bucketsPerRow by numBuckets / bucketsPerRow cells, with the plane wrapped around onto it.
+    return (static_cast<size_t>(static_cast<uint32_t>(cellY)) * bucketsPerRow + static_cast<uint32_t>(cellX)) & bucketMask;
+}
+
+inline size_t SpatialGrid::GetNeighbourBucket(const size_t bucket, const int32_t offsetX, const int32_t offsetY) const
+{
+    return (bucket + static_cast<size_t>(static_cast<ptrdiff_t>(offsetY)) * bucketsPerRow + static_cast<size_t>(static_cast<ptrdiff_t>(offsetX))) & bucketMask;
+}
+
+template<typename Function>
+void SpatialGrid::ForEachInCell(const int32_t cellX, const int32_t cellY, const Function& function) const
+{
+    const size_t bucket = GetBucket(cellX, cellY);
+    for (uint32_t i = bucketOffsets[bucket]; i < bucketOffsets[bucket + 1]; i++)
+    {
+        // Skip entities of other cells that were hashed into the same bucket.
+        if (GetCellCoordinate(sortedX[i]) == cellX && GetCellCoordinate(sortedY[i]) == cellY)
+        {
+            function(i);
+        }
+    }
+}
+
+template<typename Function>
+void SpatialGrid::ForEachInRadius(const float x, const float y, const float radius, const Function& function) const
+{
+    const float radiusSquared = radius * radius;
+    const int32_t minCellX = GetCellCoordinate(x - radius);
+    const int32_t maxCellX = GetCellCoordinate(x + radius);
+    const int32_t minCellY = GetCellCoordinate(y - radius);
+    const int32_t maxCellY = GetCellCoordinate(y + radius);
+    for (int32_t cellY = minCellY; cellY <= maxCellY; cellY++)
+    {
+        for (int32_t cellX = minCellX; cellX <= maxCellX; cellX++)
+        {
+            ForEachInCell(cellX, cellY, [&](const uint32_t sorted)
+            {
+                const float deltaX = sortedX[sorted] - x;
+                const float deltaY = sortedY[sorted] - y;
+                const float distanceSquared = deltaX * deltaX + deltaY * deltaY;
+                if (distanceSquared <= radiusSquared)
+                {
+                    function(sortedIndices[sorted], distanceSquared);
+                }
+            });
+        }
+    }
+}
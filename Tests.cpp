@@ -0,0 +1,567 @@
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "Arena.h"
+#include "JobSystem.h"
+#include "Entity.h"
+#include "PositionFrame.h"
+#include "RenderJob.h"
+#include "SpatialGrid.h"
+#include "Snapshot.h"
+#include "TripleBuffer.h"
+#include "LatencyHistogram.h"
+#include "ActiveSet.h"
+#include "EntityHandles.h"
+#include "CollisionJob.h"
+
+// Checks of what the core computes, every test is run on its own by ctest as an argument to this executable.
+// A test reports every check that failed and keeps going, so one run shows all of them.
+namespace Tests
+{
+    bool Check(const bool condition, const std::string& what)
+    {
+        if (!condition)
+        {
+            std::cerr << "Failed: " << what << std::endl;
+        }
+
+        return condition;
+    }
+
+    // Entities spread over a square of the given size around the origin, the same ones every run.
+    void RandomizePositions(const Entity::Positions& positions, const float size, const uint32_t seed)
+    {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> distribution(-0.5f * size, 0.5f * size);
+        for (size_t i = 0; i < positions.x.size(); i++)
+        {
+            positions.x[i] = distribution(generator);
+            positions.y[i] = distribution(generator);
+        }
+    }
+
+    float GetDistanceSquared(const Entity::Positions& positions, const size_t index, const float x, const float y)
+    {
+        const float deltaX = positions.x[index] - x;
+        const float deltaY = positions.y[index] - y;
+        return deltaX * deltaX + deltaY * deltaY;
+    }
+
+    // Radius and nearest queries against a brute force search of every entity. Some query points are entities, some are empty space and some are far outside the world.
+    bool TestSpatialGrid()
+    {
+        constexpr size_t numEntities = 5000;
+        constexpr float cellSize = 0.5f;
+        Arena arena(Entity::GetPositionsBytes(numEntities) + SpatialGrid::GetArenaBytes(numEntities), false);
+        const Entity::Positions positions = Entity::AllocatePositions(arena, numEntities);
+        RandomizePositions(positions, 20.0f, 1);
+
+        SpatialGrid grid(arena, numEntities, cellSize);
+        grid.Build(positions);
+
+        bool isPassing = Check(grid.GetSortedIndices().size() == numEntities, "every entity is in the grid");
+        for (size_t bucket = 0; bucket < grid.GetNumBuckets(); bucket++)
+        {
+            for (uint32_t sorted = grid.GetBucketBegin(bucket); sorted + 1 < grid.GetBucketEnd(bucket); sorted++)
+            {
+                isPassing &= Check(grid.GetSortedIndices()[sorted] < grid.GetSortedIndices()[sorted + 1], "entities of a bucket are in ascending index order");
+            }
+        }
+
+        std::vector<std::pair<float, float>> queries{ { 0.0f, 0.0f }, { 9.9f, -9.9f }, { -10.0f, 10.0f }, { 100.0f, 100.0f }, { -0.25f, 0.25f } };
+        for (size_t i = 0; i < numEntities; i += 97)
+        {
+            queries.emplace_back(positions.x[i], positions.y[i]);
+        }
+
+        for (const auto& [x, y] : queries)
+        {
+            const std::string where = " around (" + std::to_string(x) + ", " + std::to_string(y) + ")";
+            for (const float radius : { 0.1f, 0.7f, 3.0f })
+            {
+                std::vector<std::pair<uint32_t, float>> found;
+                grid.ForEachInRadius(x, y, radius, [&found](const uint32_t index, const float distanceSquared)
+                {
+                    found.emplace_back(index, distanceSquared);
+                });
+                std::sort(found.begin(), found.end());
+
+                std::vector<std::pair<uint32_t, float>> expected;
+                for (uint32_t i = 0; i < numEntities; i++)
+                {
+                    const float distanceSquared = GetDistanceSquared(positions, i, x, y);
+                    if (distanceSquared <= radius * radius)
+                    {
+                        expected.emplace_back(i, distanceSquared);
+                    }
+                }
+
+                isPassing &= Check(found == expected, "every entity within " + std::to_string(radius) + where + " is found once");
+            }
+
+            // Nearest first, ties to the lower index, nothing past the radius.
+            constexpr size_t numNeighbours = 8;
+            constexpr float maxRadius = 1.5f;
+            std::array<uint32_t, numNeighbours> neighbours;
+            std::array<float, numNeighbours> neighbourDistances;
+            const size_t numFound = grid.FindNearest(x, y, maxRadius, neighbours, neighbourDistances);
+
+            std::vector<std::pair<float, uint32_t>> expected;
+            for (uint32_t i = 0; i < numEntities; i++)
+            {
+                const float distanceSquared = GetDistanceSquared(positions, i, x, y);
+                if (distanceSquared <= maxRadius * maxRadius)
+                {
+                    expected.emplace_back(distanceSquared, i);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            expected.resize(std::min(expected.size(), numNeighbours));
+
+            bool isMatching = numFound == expected.size();
+            for (size_t i = 0; isMatching && i < numFound; i++)
+            {
+                isMatching = neighbours[i] == expected[i].second && neighbourDistances[i] == expected[i].first;
+            }
+            isPassing &= Check(isMatching, "the " + std::to_string(numNeighbours) + " nearest entities" + where);
+        }
+
+        // A grid built again from fewer entities holds only those.
+        const size_t numRebuilt = numEntities / 3;
+        grid.Build(Entity::GetFirst(positions, numRebuilt));
+        size_t numInRadius = 0;
+        grid.ForEachInRadius(0.0f, 0.0f, 100.0f, [&numInRadius, &isPassing, numRebuilt](const uint32_t index, float)
+        {
+            numInRadius++;
+            isPassing &= Check(index < numRebuilt, "a grid built again has none of the old entities");
+        });
+        isPassing &= Check(numInRadius == numRebuilt, "a grid built again has all of the new entities");
+
+        return isPassing;
+    }
+
+    // Saves entities with gaps in their ids in a shuffled order, they have to come back in order of their ids with every value exactly as it was.
+    bool TestSnapshot()
+    {
+        constexpr size_t numEntities = 3000;
+        Arena arena(Entity::GetWorldBytes(numEntities), false);
+        const Entity::Positions positions = Entity::AllocatePositions(arena, numEntities);
+        const Entity::Velocities velocities = Entity::AllocateVelocities(arena, numEntities);
+        const Entity::Physics physics = Entity::AllocatePhysics(arena, numEntities);
+        RandomizePositions(positions, 100.0f, 2);
+
+        std::vector<uint32_t> entityIds(numEntities);
+        std::mt19937 generator(3);
+        for (size_t i = 0; i < numEntities; i++)
+        {
+            entityIds[i] = static_cast<uint32_t>(2 * i + 1);
+            velocities.speed[i] = static_cast<float>(i) * 0.25f;
+            velocities.directionX[i] = std::cos(static_cast<float>(i));
+            velocities.directionY[i] = std::sin(static_cast<float>(i));
+            physics.acceleration[i] = -static_cast<float>(i % 7);
+        }
+        std::shuffle(entityIds.begin(), entityIds.end(), generator);
+
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / ("MultiThreadedCLionTests." + std::to_string(getpid()) + ".snapshot");
+        constexpr uint64_t seed = 1234567890123ull;
+        constexpr uint64_t frameIndex = 4321;
+        constexpr double simulatedTime = 71.5;
+        if (!Check(Snapshot::Save(path.string(), positions, velocities, physics, entityIds, seed, frameIndex, simulatedTime), "the snapshot is saved"))
+        {
+            return false;
+        }
+
+        bool isPassing = true;
+        {
+            Snapshot snapshot;
+            if (!Check(snapshot.Open(path.string()), "the saved snapshot opens"))
+            {
+                std::filesystem::remove(path);
+                return false;
+            }
+
+            isPassing &= Check(snapshot.GetNumEntities() == numEntities, "the number of entities is loaded");
+            isPassing &= Check(snapshot.GetSeed() == seed, "the seed is loaded");
+            isPassing &= Check(snapshot.GetFrameIndex() == frameIndex, "the frame index is loaded");
+            isPassing &= Check(snapshot.GetSimulatedTime() == simulatedTime, "the simulated time is loaded");
+
+            // Ids are 2 * slot + 1 before shuffling, so the entity of the id loaded into place i was in the slot its id was shuffled to.
+            std::vector<uint32_t> slots(numEntities);
+            for (uint32_t slot = 0; slot < numEntities; slot++)
+            {
+                slots[(entityIds[slot] - 1) / 2] = slot;
+            }
+
+            const Entity::Positions loadedPositions = snapshot.GetPositions();
+            const Entity::Velocities loadedVelocities = snapshot.GetVelocities();
+            const Entity::Physics loadedPhysics = snapshot.GetPhysics();
+            bool isMatching = loadedPositions.x.size() == numEntities;
+            for (size_t i = 0; isMatching && i < numEntities; i++)
+            {
+                const uint32_t slot = slots[i];
+                isMatching = loadedPositions.x[i] == positions.x[slot] && loadedPositions.y[i] == positions.y[slot]
+                    && loadedVelocities.speed[i] == velocities.speed[slot] && loadedVelocities.directionX[i] == velocities.directionX[slot]
+                    && loadedVelocities.directionY[i] == velocities.directionY[slot] && loadedPhysics.acceleration[i] == physics.acceleration[slot];
+            }
+            isPassing &= Check(isMatching, "every entity is loaded as it was saved, in order of its id");
+        }
+
+        std::filesystem::remove(path);
+        Snapshot missing;
+        isPassing &= Check(!missing.Open(path.string()), "a missing snapshot doesn't open");
+        return isPassing;
+    }
+
+    bool TestTripleBuffer()
+    {
+        TripleBuffer<int> buffer(0, 0, 0);
+        buffer.GetWriteBuffer() = 1;
+        buffer.Publish();
+        bool isPassing = Check(buffer.GetLastPublished() == 1, "the last published buffer is the one written");
+        isPassing &= Check(buffer.Acquire() == 1, "the reader gets the published buffer");
+        isPassing &= Check(buffer.Acquire() == 1, "the reader keeps its buffer until something new is published");
+
+        buffer.GetWriteBuffer() = 2;
+        buffer.Publish();
+        buffer.GetWriteBuffer() = 3;
+        buffer.Publish();
+        isPassing &= Check(buffer.GetNumDropped() == 1, "a buffer published over before it was read is dropped");
+        isPassing &= Check(buffer.Acquire() == 3, "the reader gets the newest buffer");
+
+        // The reader never sees a buffer older than one it has seen already, and gets the last one in the end.
+        constexpr int numPublished = 200000;
+        TripleBuffer<int> shared(0, 0, 0);
+        std::thread writer([&shared]
+        {
+            for (int i = 1; i <= numPublished; i++)
+            {
+                shared.GetWriteBuffer() = i;
+                shared.Publish();
+            }
+        });
+
+        int last = 0;
+        bool isInOrder = true;
+        while (last < numPublished)
+        {
+            const int value = shared.Acquire();
+            isInOrder &= value >= last;
+            last = value;
+        }
+        writer.join();
+        isPassing &= Check(isInOrder, "the reader only ever gets newer buffers");
+
+        return isPassing;
+    }
+
+    bool TestLatencyHistogram()
+    {
+        LatencyHistogram histogram;
+        bool isPassing = Check(histogram.GetCount() == 0 && histogram.GetValueAtPercentile(50.0) == 0, "an empty histogram has no samples");
+
+        constexpr uint64_t numSamples = 100000;
+        for (uint64_t i = 1; i <= numSamples; i++)
+        {
+            histogram.Record(i);
+        }
+
+        isPassing &= Check(histogram.GetCount() == numSamples, "every sample is counted");
+        isPassing &= Check(histogram.GetMax() == numSamples, "the largest sample is kept exactly");
+        isPassing &= Check(histogram.GetMean() == 0.5 * static_cast<double>(numSamples + 1), "the mean is kept exactly");
+
+        // Percentiles come out as the top of the sub-bucket they fall in, never below the real value and within about 3% above it.
+        for (const double percentile : { 1.0, 50.0, 90.0, 99.0, 99.9, 100.0 })
+        {
+            const double expected = percentile / 100.0 * static_cast<double>(numSamples);
+            const double value = static_cast<double>(histogram.GetValueAtPercentile(percentile));
+            isPassing &= Check(value >= expected && value <= expected * (1.0 + 1.0 / 32.0) + 1.0, "percentile " + std::to_string(percentile) + " is within a sub-bucket of " + std::to_string(expected));
+        }
+
+        return isPassing;
+    }
+
+    // Whatever slot an entity ends up in, the id in that slot has to be its own and its components have to have come along.
+    // Every entity's position is its id, so that is what every slot should hold.
+    bool CheckSlots(const ActiveSet& activeSet, const Entity::Positions& positions, const std::string& when)
+    {
+        bool isPassing = true;
+        const std::span<const uint32_t> ids = activeSet.GetAllEntityIds();
+        std::vector<uint32_t> sortedIds(ids.begin(), ids.end());
+        std::sort(sortedIds.begin(), sortedIds.end());
+        std::vector<uint32_t> allIds(ids.size());
+        std::iota(allIds.begin(), allIds.end(), 0);
+        isPassing &= Check(sortedIds == allIds, "every id is in exactly one slot " + when);
+
+        for (uint32_t slot = 0; slot < activeSet.GetNumLive(); slot++)
+        {
+            isPassing &= Check(activeSet.GetSlot(ids[slot]) == slot, "the slot of entity " + std::to_string(ids[slot]) + " is where it is " + when);
+            isPassing &= Check(positions.x[slot] == static_cast<float>(ids[slot]), "entity " + std::to_string(ids[slot]) + " kept its components " + when);
+        }
+
+        return isPassing;
+    }
+
+    struct TestWorld
+    {
+        static constexpr size_t capacity = 64;
+        static constexpr size_t chunkSize = 16;
+
+        TestWorld() : arena(2 * Entity::GetPositionsBytes(capacity) + 2 * RenderJob::GetVisibilityBinsArenaBytes(capacity, chunkSize) + Entity::GetVelocitiesBytes(capacity)
+            + Entity::GetPhysicsBytes(capacity) + ActiveSet::GetArenaBytes(capacity, chunkSize), false),
+            frames{ PositionFrame{ Entity::AllocatePositions(arena, capacity), RenderJob::CreateVisibilityBins(arena, capacity, chunkSize) },
+                PositionFrame{ Entity::AllocatePositions(arena, capacity), RenderJob::CreateVisibilityBins(arena, capacity, chunkSize) } },
+            velocities(Entity::AllocateVelocities(arena, capacity)), physics(Entity::AllocatePhysics(arena, capacity))
+        {
+            for (size_t i = 0; i < capacity; i++)
+            {
+                frames[0].positions.x[i] = static_cast<float>(i);
+                frames[0].positions.y[i] = 0.0f;
+                velocities.speed[i] = 1.0f;
+                velocities.directionX[i] = 1.0f;
+                velocities.directionY[i] = 0.0f;
+                physics.acceleration[i] = 0.0f;
+            }
+        }
+
+        Arena arena;
+        std::array<PositionFrame, 2> frames;
+        Entity::Velocities velocities;
+        Entity::Physics physics;
+    };
+
+    bool TestActiveSet()
+    {
+        constexpr size_t numLive = 40;
+        TestWorld world;
+        ActiveSet activeSet(world.arena, TestWorld::capacity, numLive, TestWorld::chunkSize, true);
+        PositionFrame& frame = world.frames[0];
+
+        // Every third entity comes to rest.
+        size_t numResting = 0;
+        for (size_t slot = 0; slot < numLive; slot += 3)
+        {
+            world.velocities.speed[slot] = 0.0f;
+            numResting++;
+        }
+
+        activeSet.Compact(frame.positions, frame.bins, world.velocities, world.physics);
+        activeSet.Publish(frame, world.frames);
+        bool isPassing = Check(activeSet.GetNumActive() == numLive - numResting, "entities that came to rest are no longer active");
+        isPassing &= Check(activeSet.GetSimulatedEnd() == std::min((activeSet.GetNumActive() + TestWorld::chunkSize - 1) / TestWorld::chunkSize * TestWorld::chunkSize, numLive), "the simulated end is the chunk of the last active entity");
+        for (size_t slot = 0; slot < numLive; slot++)
+        {
+            isPassing &= Check((world.velocities.speed[slot] > 0.0f) == (slot < activeSet.GetNumActive()), "moving entities are in front of resting ones");
+        }
+        isPassing &= CheckSlots(activeSet, frame.positions, "after resting entities are compacted");
+
+        bool isSynced = true;
+        activeSet.ForEachSwappedSlot([&world, &isSynced](const uint32_t slot)
+        {
+            isSynced &= world.frames[1].positions.x[slot] == world.frames[0].positions.x[slot];
+        });
+        isPassing &= Check(isSynced, "swapped entities are copied into the other frame");
+
+        // A resting entity that is pushed moves back in front.
+        const uint32_t pushedId = activeSet.GetEntityIds()[numLive - 1];
+        world.velocities.speed[numLive - 1] = 1.0f;
+        activeSet.Compact(frame.positions, frame.bins, world.velocities, world.physics);
+        activeSet.Publish(frame, world.frames);
+        isPassing &= Check(activeSet.GetNumActive() == numLive - numResting + 1, "a pushed entity is active again");
+        isPassing &= Check(activeSet.GetSlot(pushedId) < activeSet.GetNumActive(), "a pushed entity is in front of the resting ones");
+        isPassing &= CheckSlots(activeSet, frame.positions, "after a resting entity is pushed");
+
+        return isPassing;
+    }
+
+    bool TestEntityHandles()
+    {
+        constexpr size_t numLive = 10;
+        TestWorld world;
+        ActiveSet activeSet(world.arena, TestWorld::capacity, numLive, TestWorld::chunkSize, false);
+        EntityHandles handles(TestWorld::capacity, numLive);
+        PositionFrame& frame = world.frames[0];
+
+        const EntityHandle despawned = handles.GetHandle(3);
+        handles.Despawn(despawned);
+        handles.Despawn(despawned);
+        bool isPassing = Check(!handles.IsAlive(despawned), "a despawned handle is no longer alive");
+        isPassing &= Check(handles.GetNumAlive() == numLive - 1, "despawning twice only despawns once");
+
+        // The freed id is the lowest one, it is handed out again with a new generation. The entity's position is its id, like every other entity's.
+        const Entity::State state{ 3.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f };
+        const EntityHandle reused = handles.Spawn(state);
+        isPassing &= Check(reused.id == despawned.id && reused.generation != despawned.generation, "a freed id is reused with a new generation");
+        isPassing &= Check(handles.IsAlive(reused) && !handles.IsAlive(despawned), "only the newest handle of an id is alive");
+
+        const EntityHandle spawned = handles.Spawn(Entity::State{ 10.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f });
+        const EntityHandle dropped = handles.Spawn(Entity::State{ 11.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f });
+        handles.Despawn(dropped);
+        isPassing &= Check(spawned.id == numLive, "new entities take the lowest free id");
+
+        handles.Apply(activeSet, frame, world.frames, world.velocities, world.physics);
+        isPassing &= Check(activeSet.GetNumLive() == numLive + 1, "applying adds the entities still alive and removes the despawned ones");
+        isPassing &= Check(handles.GetNumSpawned() == 2 && handles.GetNumDespawned() == 1, "a spawn despawned before it was applied is skipped");
+        isPassing &= Check(activeSet.GetSlot(dropped.id) >= activeSet.GetNumLive(), "a spawn despawned before it was applied never becomes live");
+        isPassing &= CheckSlots(activeSet, frame.positions, "after spawning and despawning");
+
+        const uint32_t slot = activeSet.GetSlot(reused.id);
+        isPassing &= Check(world.velocities.speed[slot] == state.speed && world.velocities.directionX[slot] == state.directionX, "a spawned entity starts out as it was asked for");
+
+        // Ids run out at the capacity.
+        size_t numSpawned = 0;
+        while (handles.Spawn(state).id != EntityHandle::invalidId)
+        {
+            numSpawned++;
+        }
+        isPassing &= Check(numSpawned == TestWorld::capacity - (numLive + 1), "every free id can be spawned, and no more");
+
+        return isPassing;
+    }
+
+    struct Motion
+    {
+        double kineticEnergy;
+        double momentumX;
+        double momentumY;
+        double momentumScale; // Sum of the sizes of every entity's momentum, what rounding errors in the total are relative to.
+    };
+
+    // Every entity has the same mass, so it is left out.
+    Motion MeasureMotion(const Entity::Velocities& velocities)
+    {
+        Motion motion{};
+        for (size_t i = 0; i < velocities.speed.size(); i++)
+        {
+            const double speed = velocities.speed[i];
+            motion.kineticEnergy += 0.5 * speed * speed;
+            motion.momentumX += speed * velocities.directionX[i];
+            motion.momentumY += speed * velocities.directionY[i];
+            motion.momentumScale += std::abs(speed);
+        }
+
+        return motion;
+    }
+
+    // Runs collision steps over entities packed so tightly most of them touch several others at once, without moving them in between so the same pairs keep bouncing.
+    // No step may add energy or change the total momentum by more than rounding.
+    bool CheckCollisionSteps(const size_t numEntities, const float worldSize, const float radius, const size_t numSteps)
+    {
+        Arena arena(Entity::GetPositionsBytes(numEntities) + Entity::GetVelocitiesBytes(numEntities) + CollisionJob::GetArenaBytes(numEntities), false);
+        const Entity::Positions positions = Entity::AllocatePositions(arena, numEntities);
+        Entity::Velocities velocities = Entity::AllocateVelocities(arena, numEntities);
+        RandomizePositions(positions, worldSize, 4);
+
+        std::mt19937 generator(5);
+        std::uniform_real_distribution<float> speeds(0.0f, 10.0f);
+        std::uniform_real_distribution<float> angles(0.0f, 6.2831853f);
+        for (size_t i = 0; i < numEntities; i++)
+        {
+            const float angle = angles(generator);
+            velocities.speed[i] = speeds(generator);
+            velocities.directionX[i] = std::cos(angle);
+            velocities.directionY[i] = std::sin(angle);
+        }
+
+        CollisionJob collisions(arena, numEntities, radius);
+        const std::string what = std::to_string(numEntities) + " entities of radius " + std::to_string(radius);
+        bool isPassing = true;
+        Motion before = MeasureMotion(velocities);
+        const double initialEnergy = before.kineticEnergy;
+        for (size_t step = 0; step < numSteps; step++)
+        {
+            collisions.Run(positions, velocities);
+            const Motion after = MeasureMotion(velocities);
+            const std::string when = " in step " + std::to_string(step) + " of " + what;
+            isPassing &= Check(after.kineticEnergy <= before.kineticEnergy * (1.0 + 1e-5), "no energy is added" + when);
+            isPassing &= Check(std::abs(after.momentumX - before.momentumX) <= 1e-5 * before.momentumScale && std::abs(after.momentumY - before.momentumY) <= 1e-5 * before.momentumScale,
+                "momentum is kept" + when);
+            before = after;
+        }
+
+        isPassing &= Check(collisions.GetNumContacts() > numEntities, "most of the " + what + " touch others");
+        isPassing &= Check(before.kineticEnergy < initialEnergy, "entities touching several others at once lose energy, " + what);
+        return isPassing;
+    }
+
+    bool TestCollisions()
+    {
+        // Two entities meeting head on swap their velocities.
+        constexpr size_t numPair = 2;
+        Arena arena(Entity::GetPositionsBytes(numPair) + Entity::GetVelocitiesBytes(numPair) + CollisionJob::GetArenaBytes(numPair), false);
+        const Entity::Positions positions = Entity::AllocatePositions(arena, numPair);
+        Entity::Velocities velocities = Entity::AllocateVelocities(arena, numPair);
+        positions.x[0] = 0.0f;
+        positions.y[0] = 0.0f;
+        positions.x[1] = 1.5f;
+        positions.y[1] = 0.0f;
+        velocities.speed[0] = 1.0f;
+        velocities.directionX[0] = 1.0f;
+        velocities.directionY[0] = 0.0f;
+        velocities.speed[1] = 2.0f;
+        velocities.directionX[1] = -1.0f;
+        velocities.directionY[1] = 0.0f;
+
+        CollisionJob pair(arena, numPair, 1.0f);
+        pair.Run(positions, velocities);
+        bool isPassing = Check(velocities.speed[0] == 2.0f && velocities.directionX[0] == -1.0f && velocities.speed[1] == 1.0f && velocities.directionX[1] == 1.0f,
+            "two entities meeting head on swap their velocities");
+
+        // Moving apart they are left alone.
+        pair.Run(positions, velocities);
+        isPassing &= Check(velocities.speed[0] == 2.0f && velocities.directionX[0] == -1.0f && velocities.speed[1] == 1.0f && velocities.directionX[1] == 1.0f,
+            "two entities moving apart are left alone");
+
+        isPassing &= CheckCollisionSteps(1000, 20.0f, 1.0f, 20);
+        isPassing &= CheckCollisionSteps(250000, 20.0f, 0.02f, 5);
+        return isPassing;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::array<std::pair<std::string, bool (*)()>, 7> tests{ {
+        { "SpatialGrid", Tests::TestSpatialGrid },
+        { "Snapshot", Tests::TestSnapshot },
+        { "TripleBuffer", Tests::TestTripleBuffer },
+        { "LatencyHistogram", Tests::TestLatencyHistogram },
+        { "ActiveSet", Tests::TestActiveSet },
+        { "EntityHandles", Tests::TestEntityHandles },
+        { "Collisions", Tests::TestCollisions },
+    } };
+
+    // Every test without arguments, otherwise just the ones named.
+    JobSystem::Initialize();
+    bool isPassing = true;
+    size_t numRun = 0;
+    for (const auto& [name, test] : tests)
+    {
+        if (argc > 1 && std::find(argv + 1, argv + argc, name) == argv + argc)
+        {
+            continue;
+        }
+
+        const bool isTestPassing = test();
+        std::cout << (isTestPassing ? "Passed: " : "FAILED: ") << name << std::endl;
+        isPassing &= isTestPassing;
+        numRun++;
+    }
+    JobSystem::ShutDown();
+
+    if (numRun == 0)
+    {
+        std::cerr << "No test is called that." << std::endl;
+        return 1;
+    }
+
+    return isPassing ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Trace
+{
+    struct Event
+    {
+        const char* name;
+        int64_t begin;
+        int64_t end;
+    };
+
+    struct ThreadSpans
+    {
+        std::string name;
+        std::vector<Event> events = std::vector<Event>(spansPerThread);
+        uint64_t numRecorded = 0;
+    };
+
+    std::atomic<bool> isStarted{false};
+    std::chrono::high_resolution_clock::time_point traceStart;
+
+    // Owns every thread's spans, so they are still around to be written once the threads are gone.
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadSpans>> threads;
+
+    thread_local ThreadSpans* threadSpans = nullptr;
+    thread_local const char* threadName = "Worker";
+
+    int64_t GetTimestamp()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - traceStart).count();
+    }
+
+    // The calling thread's spans, made the first time it records one.
+    ThreadSpans& GetThreadSpans()
+    {
+        if (threadSpans != nullptr)
+        {
+            return *threadSpans;
+        }
+
+        std::unique_ptr<ThreadSpans> spans = std::make_unique<ThreadSpans>();
+        spans->name = threadName;
+        threadSpans = spans.get();
+
+        std::lock_guard lock(threadsMutex);
+        threads.push_back(std::move(spans));
+        return *threadSpans;
+    }
+
+    void Start()
+    {
+        // Released once traceStart is set, so every thread that sees tracing has started also sees what spans are timed from.
+        traceStart = std::chrono::high_resolution_clock::now();
+        isStarted.store(true, std::memory_order_release);
+    }
+
+    bool IsStarted()
+    {
+        return isStarted.load(std::memory_order_acquire);
+    }
+
+    void SetThreadName(const char* name)
+    {
+        threadName = name;
+        if (threadSpans != nullptr)
+        {
+            std::lock_guard lock(threadsMutex);
+            threadSpans->name = name;
+        }
+    }
+
+    Span::Span(const char* nameIn) : name(nameIn)
+    {
+        if (isStarted.load(std::memory_order_acquire))
+        {
+            begin = GetTimestamp();
+        }
+    }
+
+    Span::~Span()
+    {
+        if (begin < 0)
+        {
+            return;
+        }
+
+        // Spans are recorded as they end, so one that is still open when the ring wraps around never loses its place.
+        ThreadSpans& spans = GetThreadSpans();
+        spans.events[spans.numRecorded % spansPerThread] = Event{ name, begin, GetTimestamp() };
+        spans.numRecorded++;
+    }
+
+    uint64_t GetNumWritten()
+    {
+        std::lock_guard lock(threadsMutex);
+        uint64_t numWritten = 0;
+        for (const std::unique_ptr<ThreadSpans>& spans : threads)
+        {
+            numWritten += std::min<uint64_t>(spans->numRecorded, spansPerThread);
+        }
+
+        return numWritten;
+    }
+
+    uint64_t GetNumOverwritten()
+    {
+        std::lock_guard lock(threadsMutex);
+        uint64_t numOverwritten = 0;
+        for (const std::unique_ptr<ThreadSpans>& spans : threads)
+        {
+            numOverwritten += spans->numRecorded - std::min<uint64_t>(spans->numRecorded, spansPerThread);
+        }
+
+        return numOverwritten;
+    }
+
+    bool Write(const std::string& path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        // Threads are done by now, nothing is recording any more.
+        std::lock_guard lock(threadsMutex);
+
+        // Complete events, timestamps and durations in microseconds. Thread ids are just the order threads first recorded a span in.
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << std::fixed << std::setprecision(3);
+        bool isFirst = true;
+        for (size_t thread = 0; thread < threads.size(); thread++)
+        {
+            const ThreadSpans& spans = *threads[thread];
+            file << (isFirst ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"name\":\"" << spans.name << "\"}}";
+            file << ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"sort_index\":" << thread << "}}";
+            isFirst = false;
+
+            const uint64_t first = spans.numRecorded - std::min<uint64_t>(spans.numRecorded, spansPerThread);
+            for (uint64_t i = first; i < spans.numRecorded; i++)
+            {
+                const Event& event = spans.events[i % spansPerThread];
+                file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+                    << ",\"ts\":" << static_cast<double>(event.begin) / 1000.0 << ",\"dur\":" << static_cast<double>(event.end - event.begin) / 1000.0 << "}";
+            }
+        }
+        file << "\n]}\n";
+
+        return static_cast<bool>(file);
+    }
+}
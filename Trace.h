@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A timeline of what every thread was doing, to see how the simulation and the renderer overlap within a frame and where threads sit idle waiting on each other.
+// Every thread records spans into a ring of its own the first time it traces anything, so recording never locks. A thread that records more spans than fit keeps the newest ones.
+// Written at exit in the Chrome trace event format, which Perfetto and chrome://tracing open.
+namespace Trace
+{
+    // Kept per thread, a frame records a few dozen spans on each.
+    constexpr size_t spansPerThread = 1 << 16;
+
+    // Tracing is off until started, a span is then a single load and branch. Spans are timed from the moment it starts, Start may only be called once.
+    void Start();
+    bool IsStarted();
+
+    // Threads show up on the timeline by name, in the order they first recorded a span. Threads that don't set one are named after the job system's workers.
+    void SetThreadName(const char* name);
+
+    // Records the time the calling thread spends while it is alive as a span named name. Spans inside other spans show up nested under them.
+    class Span
+    {
+    public:
+        explicit Span(const char* name);
+        ~Span();
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* name;
+        int64_t begin = -1;
+    };
+
+    // Spans every thread still has in its ring, and the older ones that were overwritten.
+    uint64_t GetNumWritten();
+    uint64_t GetNumOverwritten();
+
+    // Writes every thread's spans as Chrome trace events. No thread may still be recording.
+    bool Write(const std::string& path);
+}
@@ -0,0 +1,182 @@
+#include "TrajectoryRecorder.h"
+
+#include <algorithm>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+
+constexpr std::array<char, 8> magic{ 'M', 'T', 'D', 'O', 'T', 'R', 'A', 'J' };
+
+// The largest varint a 32 bit value needs.
+constexpr size_t maxVarintBytes = 5;
+
+constexpr double maxStep = 2147483647.0;
+
+TrajectoryRecorder::TrajectoryRecorder(Arena& arena, const size_t numEntities, const float precisionIn)
+    : precision(precisionIn), inverseStep(1.0 / precisionIn)
+{
+    for (Slot& slot : slots)
+    {
+        slot.positions = Entity::AllocatePositions(arena, numEntities);
+    }
+
+    previousStepsX = Entity::AllocateStream<int32_t>(arena, numEntities);
+    previousStepsY = Entity::AllocateStream<int32_t>(arena, numEntities);
+}
+
+size_t TrajectoryRecorder::GetArenaBytes(const size_t numEntities)
+{
+    return numSlots * Entity::GetPositionsBytes(numEntities) + 2 * Entity::GetStreamBytes<int32_t>(numEntities);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    Stop();
+}
+
+bool TrajectoryRecorder::Start(const std::string& path)
+{
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cerr << "Could not open trajectory file: " << path << std::endl;
+        return false;
+    }
+
+    const uint64_t numEntities = previousStepsX.size();
+    const uint32_t reserved = 0;
+    file.write(magic.data(), magic.size());
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+    file.write(reinterpret_cast<const char*>(&numEntities), sizeof(numEntities));
+    file.write(reinterpret_cast<const char*>(&precision), sizeof(precision));
+    file.write(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+    numBytesWritten = magic.size() + 2 * sizeof(uint32_t) + sizeof(uint64_t) + sizeof(float) + sizeof(uint32_t);
+
+    std::fill(previousStepsX.begin(), previousStepsX.end(), 0);
+    std::fill(previousStepsY.begin(), previousStepsY.end(), 0);
+    payload.resize(2 * numEntities * maxVarintBytes);
+
+    encoder = std::thread(&TrajectoryRecorder::EncoderLoop, this);
+    return true;
+}
+
+void TrajectoryRecorder::Stop()
+{
+    if (!encoder.joinable())
+    {
+        return;
+    }
+
+    head.store(head.load(std::memory_order_relaxed) | stoppedFlag, std::memory_order_release);
+    head.notify_one();
+    encoder.join();
+    file.close();
+}
+
+void TrajectoryRecorder::Capture(const Entity::Positions& positions, const std::span<const uint32_t> entityIds, const uint64_t frameIndex, const double simulatedTime)
+{
+    const uint64_t slotIndex = head.load(std::memory_order_relaxed);
+    if (!encoder.joinable() || slotIndex - tail.load(std::memory_order_acquire) >= numSlots)
+    {
+        numDropped++;
+        return;
+    }
+
+    Slot& slot = slots[slotIndex % numSlots];
+    slot.frameIndex = frameIndex;
+    slot.simulatedTime = simulatedTime;
+    for (size_t i = 0; i < entityIds.size(); i++)
+    {
+        slot.positions.x[entityIds[i]] = positions.x[i];
+        slot.positions.y[entityIds[i]] = positions.y[i];
+    }
+
+    head.store(slotIndex + 1, std::memory_order_release);
+    head.notify_one();
+}
+
+uint64_t TrajectoryRecorder::GetNumRecorded() const
+{
+    return numRecorded;
+}
+
+uint64_t TrajectoryRecorder::GetNumDropped() const
+{
+    return numDropped;
+}
+
+uint64_t TrajectoryRecorder::GetNumBytesWritten() const
+{
+    return numBytesWritten;
+}
+
+void TrajectoryRecorder::EncoderLoop()
+{
+#ifdef SCHED_IDLE
+    // Encoding is never urgent, only run it on cores the frame loop leaves idle. Without this it takes turns with the workers when every core is busy.
+    const sched_param parameters{};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &parameters);
+#endif
+
+    uint64_t slotIndex = tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+        const uint64_t published = head.load(std::memory_order_acquire);
+        if ((published & ~stoppedFlag) == slotIndex)
+        {
+            if ((published & stoppedFlag) != 0)
+            {
+                return;
+            }
+
+            head.wait(published, std::memory_order_acquire);
+            continue;
+        }
+
+        Encode(slots[slotIndex % numSlots]);
+        slotIndex++;
+        tail.store(slotIndex, std::memory_order_release);
+    }
+}
+
+void TrajectoryRecorder::Encode(const Slot& slot)
+{
+    size_t payloadSize = 0;
+    auto encodeStream = [this, &payloadSize](const std::span<const float> positions, const std::span<int32_t> previousSteps)
+    {
+        uint8_t* output = payload.data() + payloadSize;
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            // Scaled in double, a float step can't resolve precision once positions get large.
+            const double scaled = std::clamp(static_cast<double>(positions[i]) * inverseStep + (positions[i] >= 0.0f ? 0.5 : -0.5), -maxStep, maxStep);
+            const int32_t step = static_cast<int32_t>(scaled);
+
+            // Wrapping unsigned math keeps the delta defined for any two steps, the decoder wraps the same way.
+            const uint32_t delta = static_cast<uint32_t>(step) - static_cast<uint32_t>(previousSteps[i]);
+            uint32_t zigzag = (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+            previousSteps[i] = step;
+
+            while (zigzag >= 0x80)
+            {
+                *output++ = static_cast<uint8_t>(zigzag | 0x80);
+                zigzag >>= 7;
+            }
+            *output++ = static_cast<uint8_t>(zigzag);
+        }
+
+        payloadSize = static_cast<size_t>(output - payload.data());
+    };
+
+    encodeStream(slot.positions.x, previousStepsX);
+    encodeStream(slot.positions.y, previousStepsY);
+
+    const uint64_t payloadSize64 = payloadSize;
+    file.write(reinterpret_cast<const char*>(&slot.frameIndex), sizeof(slot.frameIndex));
+    file.write(reinterpret_cast<const char*>(&slot.simulatedTime), sizeof(slot.simulatedTime));
+    file.write(reinterpret_cast<const char*>(&payloadSize64), sizeof(payloadSize64));
+    file.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payloadSize));
+
+    numRecorded++;
+    numBytesWritten += 3 * sizeof(uint64_t) + payloadSize;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Arena.h"
+#include "Entity.h"
+
+// Streams position frames to a file on a thread of its own. The frame loop only copies positions into a free slot, as a job of the frame next to the others.
+// Full slots are handed to the encoder through a lock free single producer, single consumer ring. When the encoder falls behind frames are dropped, the frame loop never waits on it.
+//
+// File layout, all little endian:
+//   header: "MTDOTRAJ", uint32 version, uint32 reserved, uint64 numEntities, float precision, uint32 reserved
+//   frames: uint64 frameIndex, double simulatedTime, uint64 payloadSize, payload
+// Positions are rounded to multiples of precision, every frame stores how far each entity moved since the last recorded frame in those steps.
+// The payload is all x steps followed by all y steps, zigzag encoded into LEB128 varints. The first frame is stored as steps from zero.
+// Every frame has every id there can be, in id order. Ids that aren't alive keep whatever position their slot was left with.
+class TrajectoryRecorder
+{
+public:
+    static constexpr uint32_t version = 1;
+    static constexpr size_t numSlots = 4;
+
+    TrajectoryRecorder(Arena& arena, size_t numEntities, float precision);
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    static size_t GetArenaBytes(size_t numEntities);
+
+    bool Start(const std::string& path);
+
+    // Encodes everything captured so far and closes the file. No job may still be capturing.
+    void Stop();
+
+    // Frame loop side: copies positions into a free slot, or drops the frame when there is none. Captures must not overlap each other, but can run on any thread.
+    // Entity entityIds[i] is in slot i of positions, the file always stores entities in order.
+    void Capture(const Entity::Positions& positions, std::span<const uint32_t> entityIds, uint64_t frameIndex, double simulatedTime);
+
+    uint64_t GetNumRecorded() const;
+    uint64_t GetNumDropped() const;
+    uint64_t GetNumBytesWritten() const;
+
+private:
+    struct Slot
+    {
+        Entity::Positions positions;
+        uint64_t frameIndex = 0;
+        double simulatedTime = 0.0;
+    };
+
+    // Set on head by Stop, it changes the value the encoder sleeps on so it always wakes up for it.
+    static constexpr uint64_t stoppedFlag = 1ull << 63;
+
+    void EncoderLoop();
+    void Encode(const Slot& slot);
+
+    std::array<Slot, numSlots> slots;
+
+    // Written by the frame loop's capture job and read by the encoder. Kept on separate cache lines so the two sides don't share one.
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) uint64_t numDropped = 0;
+
+    // Only touched by the encoder thread while it is running.
+    std::span<int32_t> previousStepsX;
+    std::span<int32_t> previousStepsY;
+    std::vector<uint8_t> payload;
+    std::ofstream file;
+    uint64_t numRecorded = 0;
+    uint64_t numBytesWritten = 0;
+
+    float precision;
+    double inverseStep;
+    std::thread encoder;
+};
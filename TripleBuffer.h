@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// One writer and one reader exchange whole buffers by swapping indices, nothing is ever copied.
+// The writer always has a buffer of its own to write into, and the reader always gets the newest published one.
+template<typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer(T first, T second, T third) : buffers{ first, second, third } {}
+
+    // Writer side: the buffer to write the next frame into.
+    T& GetWriteBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    // Writer side: the last buffer that was published. The reader might be reading it at the same time, so it must only be read.
+    const T& GetLastPublished() const
+    {
+        return buffers[lastPublishedIndex];
+    }
+
+    // Writer side: hands the write buffer over to the reader and picks up a free buffer to write the next frame into.
+    // When the reader is slower than the writer, the buffer picked up can be one that was published but never read, it is dropped.
+    void Publish()
+    {
+        lastPublishedIndex = writeIndex;
+        const uint32_t previous = shared.exchange(writeIndex | freshFlag, std::memory_order_acq_rel);
+        writeIndex = previous & indexMask;
+        numDropped += (previous & freshFlag) != 0 ? 1 : 0;
+    }
+
+    // Writer side: published buffers the reader never got to see.
+    uint64_t GetNumDropped() const
+    {
+        return numDropped;
+    }
+
+    // Reader side: the newest published buffer, it stays valid until the next call.
+    const T& Acquire()
+    {
+        if ((shared.load(std::memory_order_relaxed) & freshFlag) != 0)
+        {
+            const uint32_t previous = shared.exchange(readIndex, std::memory_order_acq_rel);
+            readIndex = previous & indexMask;
+        }
+
+        return buffers[readIndex];
+    }
+
+private:
+    static constexpr uint32_t indexMask = 0x3;
+    static constexpr uint32_t freshFlag = 0x4;
+
+    std::array<T, 3> buffers;
+
+    uint32_t writeIndex = 0;
+    uint32_t lastPublishedIndex = 0;
+    uint32_t readIndex = 1;
+    uint64_t numDropped = 0;
+    std::atomic<uint32_t> shared{2};
+};
@@ -1,58 +1,348 @@
 #include <iostream>
-#include <thread>
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <cmath>
+#include <optional>
+#include <thread>
 
 #include "Vector.h"
 #include "Clocks.h"
+#include "Config.h"
+#include "Arena.h"
 #include "Entity.h"
+#include "PositionFrame.h"
+#include "FramePipeline.h"
+#include "JobSystem.h"
+#include "JobGraph.h"
 #include "RandomizeJob.h"
 #include "SimulateMotionJob.h"
 #include "RenderJob.h"
+#include "CollisionJob.h"
+#include "ActiveSet.h"
+#include "EntityHandles.h"
+#include "Snapshot.h"
+#include "TrajectoryRecorder.h"
+#include "RasterizeJob.h"
+#include "PerfCounters.h"
+#include "Trace.h"
 
-#define RUN_ASYNC
-
-int main()
+int main(int argc, char** argv)
 {
-    std::array<Entity::Position, Entity::numEntities> positions {};
-    std::array<Entity::Velocity, Entity::numEntities> velocities {};
-    std::array<Entity::Physics, Entity::numEntities> physics {};
+    Config::Settings settings;
+    if (!Config::Parse(argc, argv, settings))
+    {
+        return 1;
+    }
+
+    SimulateMotionJob::SetGrainSize(settings.grainSize);
+    if (!SimulateMotionJob::SetKernel(settings.motionKernel))
+    {
+        std::cerr << "The " << SimulateMotionJob::GetKernelName(settings.motionKernel) << " motion kernel isn't supported on this CPU." << std::endl;
+        return 1;
+    }
+
+    // The world has to come out the same for a seed on every machine, a generator version that has gone wrong would quietly give a different one.
+    if (!RandomizeJob::CheckKnownAnswers())
+    {
+        return 1;
+    }
+
+    // A loaded snapshot decides how many entities there are to begin with, its streams are used in place instead of being allocated and randomized.
+    Snapshot snapshot;
+    if (!settings.loadSnapshotPath.empty())
+    {
+        if (!snapshot.Open(settings.loadSnapshotPath))
+        {
+            return 1;
+        }
+
+        settings.numEntities = snapshot.GetNumEntities();
+        settings.seed = snapshot.GetSeed();
+        Clocks::SetSimulatedTime(snapshot.GetSimulatedTime());
+    }
+
+    // Every stream has room for the most entities there can be at once, the live ones are packed at the front.
+    // The arena takes what every part that is turned on allocates from it, the visibility bins of the simulation's two frames among them. A snapshot used in place needs less.
+    const size_t capacity = std::max(settings.maxEntities, settings.numEntities);
+    const size_t grainSize = SimulateMotionJob::GetGrainSize();
+    size_t arenaBytes = Entity::GetWorldBytes(capacity) + 2 * RenderJob::GetVisibilityBinsArenaBytes(capacity, grainSize)
+        + FramePipeline::GetArenaBytes(capacity, grainSize) + ActiveSet::GetArenaBytes(capacity, grainSize);
+    if (settings.collisionRadius > 0.0f)
+    {
+        arenaBytes += CollisionJob::GetArenaBytes(capacity);
+    }
+    if (!settings.trajectoryPath.empty())
+    {
+        arenaBytes += TrajectoryRecorder::GetArenaBytes(capacity);
+    }
+    if (!settings.imagePath.empty())
+    {
+        arenaBytes += RasterizeJob::GetArenaBytes(capacity);
+    }
+    Arena arena(arenaBytes, settings.useHugePages);
+
+    // The simulation writes one frame of positions while moving on from the last completed one, the renderer gets copies of its own through the frame pipeline.
+    // A snapshot's streams are only big enough for its own entities, with room for more they are copied into streams of their own.
+    const bool isSnapshotInPlace = snapshot.IsOpen() && capacity == settings.numEntities;
+    auto allocateFrame = [&arena, capacity]
+    {
+        return PositionFrame{ Entity::AllocatePositions(arena, capacity), RenderJob::CreateVisibilityBins(arena, capacity, SimulateMotionJob::GetGrainSize()) };
+    };
+    const PositionFrame snapshotFrame = isSnapshotInPlace ? PositionFrame{ snapshot.GetPositions(), RenderJob::CreateVisibilityBins(arena, capacity, SimulateMotionJob::GetGrainSize()) } : allocateFrame();
+    std::array<PositionFrame, 2> frameBuffers{ snapshotFrame, allocateFrame() };
+    Entity::Velocities velocities = isSnapshotInPlace ? snapshot.GetVelocities() : Entity::AllocateVelocities(arena, capacity);
+    Entity::Physics physics = isSnapshotInPlace ? snapshot.GetPhysics() : Entity::AllocatePhysics(arena, capacity);
 
-    RandomizeJob::Run(positions, velocities, physics);
-    RenderJob renderJob(velocities);
+    JobSystem::Initialize();
+
+    // Only threads that measure something show up in the report, every one of them opens its counters the first time it does.
+    PerfCounters::SetThreadName("Main");
+    if (settings.usePerfCounters)
+    {
+        PerfCounters::Enable();
+    }
+
+    Trace::SetThreadName("Main");
+    if (!settings.tracePath.empty())
+    {
+        Trace::Start();
+    }
+
+    PositionFrame& firstFrame = frameBuffers[0];
+    Entity::Positions firstPositions = Entity::GetFirst(firstFrame.positions, settings.numEntities);
+    Entity::Velocities firstVelocities = Entity::GetFirst(velocities, settings.numEntities);
+    Entity::Physics firstPhysics = Entity::GetFirst(physics, settings.numEntities);
+    if (!snapshot.IsOpen())
+    {
+        RandomizeJob::Run(firstPositions, firstVelocities, firstPhysics, settings.seed);
+    }
+    else if (!isSnapshotInPlace)
+    {
+        std::ranges::copy(snapshot.GetPositions().x, firstPositions.x.begin());
+        std::ranges::copy(snapshot.GetPositions().y, firstPositions.y.begin());
+        std::ranges::copy(snapshot.GetVelocities().speed, firstVelocities.speed.begin());
+        std::ranges::copy(snapshot.GetVelocities().directionX, firstVelocities.directionX.begin());
+        std::ranges::copy(snapshot.GetVelocities().directionY, firstVelocities.directionY.begin());
+        std::ranges::copy(snapshot.GetPhysics().acceleration, firstPhysics.acceleration.begin());
+    }
+    firstFrame.bins.BinAll(firstPositions);
+    RenderJob renderJob(settings.renderMode, settings.renderBackend);
+    FramePipeline pipeline(arena, capacity, SimulateMotionJob::GetGrainSize(), velocities);
+
+    std::optional<CollisionJob> collisionJob;
+    if (settings.collisionRadius > 0.0f)
+    {
+        collisionJob.emplace(arena, capacity, settings.collisionRadius);
+    }
+    CollisionJob* const collisions = collisionJob ? &*collisionJob : nullptr;
+
+    // Only collisions can set a resting entity moving again.
+    ActiveSet activeSet(arena, capacity, settings.numEntities, SimulateMotionJob::GetGrainSize(), collisions != nullptr);
+    EntityHandles entityHandles(capacity, settings.numEntities);
+
+    JobSystem::Fence frameFence;
 
     size_t numFrames = 0;
     constexpr float simTimeSeconds = 4.0f;
 
+    const uint64_t firstFrameIndex = snapshot.IsOpen() ? snapshot.GetFrameIndex() : 0;
+    // The frame the next one moves on from, and the one it is written into. They swap once the frame is done.
+    PositionFrame* lastFrame = &frameBuffers[0];
+    PositionFrame* nextFrame = &frameBuffers[1];
+
+    bool isSnapshotSaved = settings.saveSnapshotPath.empty();
+    auto saveSnapshot = [&]
+    {
+        // Only called between frames, nothing is writing the last published frame or the other streams.
+        isSnapshotSaved = true;
+        const PositionFrame& savedFrame = *lastFrame;
+        const size_t numLive = activeSet.GetNumLive();
+        if (!Snapshot::Save(settings.saveSnapshotPath, Entity::GetFirst(savedFrame.positions, numLive), Entity::GetFirst(velocities, numLive), Entity::GetFirst(physics, numLive),
+            activeSet.GetEntityIds(), settings.seed, firstFrameIndex + numFrames, Clocks::GetSimulatedTime()))
+        {
+            std::cerr << "Could not save snapshot to " << settings.saveSnapshotPath << std::endl;
+        }
+    };
+
+    std::optional<TrajectoryRecorder> recorder;
+    if (!settings.trajectoryPath.empty())
+    {
+        recorder.emplace(arena, capacity, settings.trajectoryPrecision);
+        if (!recorder->Start(settings.trajectoryPath))
+        {
+            return 1;
+        }
+    }
+
+    std::optional<RasterizeJob> rasterizer;
+    if (!settings.imagePath.empty())
+    {
+        rasterizer.emplace(arena, capacity, settings.imageWidth, settings.imageHeight);
+        if (!rasterizer->Start(settings.imagePath))
+        {
+            return 1;
+        }
+    }
+
+    // The arena rounds up to whole huge pages, a part that allocates more than it says it does would usually still fit and go unnoticed.
+    assert(arena.GetUsed() <= arenaBytes);
+
+    // Views of just the live entities in this frame's buffers, set before the graph runs.
+    PositionFrame lastLiveFrame = firstFrame;
+    PositionFrame nextLiveFrame = firstFrame;
+    Entity::Velocities liveVelocities = velocities;
+    Entity::Physics livePhysics = physics;
+    uint64_t numRespawned = 0;
+    uint64_t lastFrameIndex = 0;
+    double lastSimulatedTime = 0.0;
+    bool isCaptureFrame = false;
+    bool isImageFrame = false;
+
+    // Every job of a frame and what it touches, the graph works out which of them can run at the same time.
+    JobGraph frameGraph;
+    if (recorder)
+    {
+        frameGraph.Add("capture", { Component::PUBLISHED_POSITIONS, Component::ENTITY_ORDER }, {}, [&]
+        {
+            if (isCaptureFrame)
+            {
+                recorder->Capture(lastFrame->positions, activeSet.GetAllEntityIds(), lastFrameIndex, lastSimulatedTime);
+            }
+        });
+    }
+    if (rasterizer)
+    {
+        frameGraph.Add("rasterize", { Component::PUBLISHED_POSITIONS }, {}, [&]
+        {
+            if (isImageFrame)
+            {
+                rasterizer->Run(lastLiveFrame.positions, lastFrameIndex);
+            }
+        });
+    }
+    frameGraph.Add("simulate", { Component::PUBLISHED_POSITIONS }, { Component::POSITIONS, Component::BINS, Component::VELOCITIES, Component::PHYSICS, Component::ACTIVE_SET }, [&]
+    {
+        SimulateMotionJob::Run(lastLiveFrame.positions, nextLiveFrame.positions, nextLiveFrame.bins, liveVelocities, livePhysics, activeSet, collisions);
+    });
+
+    // Entities the simulation swapped are swapped in everything else once the frame in the old order has been captured.
+    frameGraph.Add("publish", { Component::POSITIONS, Component::VELOCITIES, Component::ACTIVE_SET }, { Component::PUBLISHED_POSITIONS, Component::PUBLISHED_BINS, Component::ENTITY_ORDER }, [&]
+    {
+        pipeline.UpdateDrawProperties(velocities, activeSet, collisions);
+        pipeline.MarkChanged(activeSet.GetLastSimulatedEnd(), activeSet);
+        activeSet.Publish(nextLiveFrame, frameBuffers);
+    });
+
+    // The renderer picks the frame up whenever it is done with the last one, the simulation never waits for it.
+    frameGraph.Add("hand off", { Component::POSITIONS, Component::BINS, Component::ENTITY_ORDER }, {}, [&]
+    {
+        pipeline.Publish(nextLiveFrame, nextLiveFrame.positions.x.size(), lastFrameIndex + 1);
+    });
+
+    // Entities that left the world are replaced with new ones. Only the entities the simulation moved this frame can have left since they were last looked at.
+    if (settings.worldBounds > 0.0f)
+    {
+        frameGraph.Add("cull", { Component::POSITIONS, Component::ACTIVE_SET, Component::ENTITY_ORDER }, { Component::ENTITY_COMMANDS }, [&]
+        {
+            // Swapped slots can come up twice, an entity that has already been replaced isn't alive any more.
+            auto cull = [&](const size_t slot)
+            {
+                const EntityHandle handle = entityHandles.GetHandle(activeSet.GetEntityIds()[slot]);
+                if (entityHandles.IsAlive(handle) && (std::abs(nextLiveFrame.positions.x[slot]) > settings.worldBounds || std::abs(nextLiveFrame.positions.y[slot]) > settings.worldBounds))
+                {
+                    entityHandles.Despawn(handle);
+                    entityHandles.Spawn(RandomizeJob::GenerateEntity(settings.seed, capacity + numRespawned++));
+                }
+            };
+
+            for (size_t slot = 0; slot < activeSet.GetLastSimulatedEnd(); slot++)
+            {
+                cull(slot);
+            }
+            activeSet.ForEachSwappedSlot(cull);
+        });
+    }
+
+    // Drawing happens on a thread of its own at whatever rate the console keeps up with, always showing the newest frame.
+    pipeline.Publish(PositionFrame{ firstPositions, firstFrame.bins }, settings.numEntities, firstFrameIndex);
+    uint64_t numRenderedFrames = 0;
+    uint64_t numRenderedEntities = 0;
+    std::thread renderThread([&pipeline, &renderJob, &numRenderedFrames, &numRenderedEntities]
+    {
+        PerfCounters::SetThreadName("Render");
+        Trace::SetThreadName("Render");
+        Clocks::StartWaitClock();
+        while (const RenderFrame* frame = pipeline.AcquireNext())
+        {
+            Clocks::PauseWaitClock();
+            renderJob.Run(Entity::GetFirst(frame->frame.positions, frame->numEntities), frame->frame.bins, frame->drawProperties.first(frame->numEntities));
+            numRenderedFrames++;
+            numRenderedEntities += frame->numEntities;
+            Clocks::StartWaitClock();
+        }
+    });
+
+    // Entities are spawned and despawned as the simulation runs, per entity figures are worked out from how many were live in every frame.
+    uint64_t numLiveEntities = 0;
     Clocks::StartAppClock();
     while (Clocks::GetTotalTime() < simTimeSeconds)
     {
+        const Trace::Span frameSpan("Frame");
+        lastFrameIndex = firstFrameIndex + numFrames;
+        lastSimulatedTime = Clocks::GetSimulatedTime();
+        isCaptureFrame = numFrames % settings.trajectoryInterval == 0;
+        isImageFrame = numFrames % settings.imageInterval == 0;
         Clocks::Update();
-        std::array<Entity::Position, Entity::numEntities> lastPositions = positions;
-
-#ifdef RUN_ASYNC
-        std::thread* renderThread = renderJob.Run(lastPositions);
-        std::thread* simulateMotionThread = SimulateMotionJob::Run(positions, velocities, physics);
 
-        renderThread->join();
-        simulateMotionThread->join();
-#else
-        std::thread* renderThread = renderJob.Run(lastPositions);
-        renderThread->join();
+        const size_t numLive = activeSet.GetNumLive();
+        numLiveEntities += numLive;
+        lastLiveFrame = PositionFrame{ Entity::GetFirst(lastFrame->positions, numLive), lastFrame->bins };
+        nextLiveFrame = PositionFrame{ Entity::GetFirst(nextFrame->positions, numLive), nextFrame->bins };
+        liveVelocities = Entity::GetFirst(velocities, numLive);
+        livePhysics = Entity::GetFirst(physics, numLive);
 
-        std::thread* simulateMotionThread = SimulateMotionJob::Run(positions, velocities, physics);
-        simulateMotionThread->join();
-#endif
+        frameGraph.Run(frameFence);
+        JobSystem::Wait(frameFence);
 
-        delete renderThread;
-        delete simulateMotionThread;
+        // The frame just done is the one the next frame moves on from, entities are added to and removed from it before anything reads it.
+        entityHandles.Apply(activeSet, *nextFrame, frameBuffers, velocities, physics);
+        pipeline.UpdateDrawProperties(velocities, activeSet);
+        pipeline.MarkChanged(0, activeSet);
+        std::swap(lastFrame, nextFrame);
 
         Clocks::SavePreviousFrameClock();
         numFrames++;
+
+        if (!isSnapshotSaved && numFrames == settings.saveSnapshotFrame)
+        {
+            saveSnapshot();
+        }
+    }
+
+    pipeline.Stop();
+    renderThread.join();
+
+    if (!isSnapshotSaved)
+    {
+        saveSnapshot();
+    }
+
+    if (recorder)
+    {
+        recorder->Stop();
+    }
+
+    if (rasterizer)
+    {
+        rasterizer->Stop();
     }
 
-    RenderJob::ShutDownConsole();
+    JobSystem::ShutDown();
+    renderJob.ShutDownConsole();
 
-    if (system("clear") == -1)
+    // Headless runs never drew on the terminal, there is nothing to clear.
+    if (settings.renderBackend != RenderBackend::HEADLESS && system("clear") == -1)
     {
         return 0;
     }
@@ -62,19 +352,68 @@ int main()
 
     const float averageFrameTime = (Clocks::GetTotalTime() * 1000.0f) / numFramesFloat;
     const float averageSimTime = (Clocks::GetSimTime() * 1000.0f) / numFramesFloat;
-    const float averageRenderTime = (Clocks::GetRenderTime() * 1000.0f) / numFramesFloat;
 
-    const float highestTime = averageSimTime > averageRenderTime ? averageSimTime : averageRenderTime;
-    const float lowestTime = averageSimTime < averageRenderTime ? averageSimTime : averageRenderTime;
+    // The renderer runs at a rate of its own, its times are per frame it drew.
+    const float numRenderedFramesFloat = static_cast<float>(numRenderedFrames);
+    const float renderFps = numRenderedFramesFloat / simTimeSeconds;
+    const float averageRenderTime = (Clocks::GetRenderTime() * 1000.0f) / numRenderedFramesFloat;
+    const float averageWaitTime = (Clocks::GetWaitTime() * 1000.0f) / numRenderedFramesFloat;
 
+    std::cout << "Num entities: " << settings.numEntities << ", Max entities: " << capacity << ", Arena: " << arena.GetUsed() / (1024 * 1024) << "MB" << (arena.IsUsingHugePages() ? " (huge pages)" : "") << std::endl;
+    std::cout << "Seed: " << settings.seed << std::endl;
+    if (snapshot.IsOpen())
+    {
+        std::cout << "Snapshot: resumed at frame " << firstFrameIndex << ", " << snapshot.GetSimulatedTime() << "s simulated" << std::endl;
+    }
+    if (recorder)
+    {
+        std::cout << "Trajectory: " << recorder->GetNumRecorded() << " frames recorded, " << recorder->GetNumDropped() << " dropped, "
+            << recorder->GetNumBytesWritten() / 1024 << "KB written to " << settings.trajectoryPath << std::endl;
+    }
+    if (rasterizer)
+    {
+        std::cout << "Images: " << rasterizer->GetNumWritten() << " written, " << rasterizer->GetNumDropped() << " dropped, "
+            << rasterizer->GetNumBytesWritten() / (1024 * 1024) << "MB written next to " << settings.imagePath << std::endl;
+    }
+    if (collisionJob)
+    {
+        std::cout << "Collisions: radius " << collisionJob->GetRadius() << ", " << static_cast<float>(collisionJob->GetNumContacts()) / numFramesFloat << " contacts per frame" << std::endl;
+    }
+    std::cout << "Active entities: " << activeSet.GetNumActive() << " still moving at exit" << std::endl;
+    std::cout << "Live entities: " << activeSet.GetNumLive() << " at exit, " << entityHandles.GetNumSpawned() << " spawned, " << entityHandles.GetNumDespawned() << " despawned" << std::endl;
+    std::cout << "Motion kernel: " << SimulateMotionJob::GetKernelName(SimulateMotionJob::GetKernel()) << std::endl;
+    std::cout << "Render backend: " << RenderJob::GetBackendName(settings.renderBackend) << std::endl;
     std::cout << "Num frames: " << numFrames << ", Average FPS: " << fps << std::endl;
+    std::cout << "Rendered frames: " << numRenderedFrames << ", " << pipeline.GetNumDropped() << " dropped, Average Render FPS: " << renderFps << std::endl;
     std::cout << "Average Frame Time: " << averageFrameTime << "ms" << std::endl;
     std::cout << "Average Sim Thread Time: " << averageSimTime << "ms" << std::endl;
     std::cout << "Average Render Thread Time: " << averageRenderTime << "ms" << std::endl;
+    std::cout << "Average Waiting Time: " << averageWaitTime << "ms" << std::endl;
+
+    Clocks::PrintLatencyPercentiles(std::cout);
+
+    if (settings.usePerfCounters)
+    {
+        PerfCounters::PrintReport(std::cout, PerfCounters::Workload{ numFrames, numLiveEntities, numRenderedFrames, numRenderedEntities, snapshot.IsOpen() ? 0 : settings.numEntities });
+    }
+
+    if (!settings.latencyReportPath.empty() && !Clocks::ExportLatencies(settings.latencyReportPath))
+    {
+        std::cerr << "Could not write latency report to " << settings.latencyReportPath << std::endl;
+    }
 
-#ifdef RUN_ASYNC
-    std::cout << "Average Waiting Time: " << highestTime - lowestTime << "ms" << std::endl;
-#endif
+    // Every thread that recorded spans has been joined by now.
+    if (!settings.tracePath.empty())
+    {
+        if (Trace::Write(settings.tracePath))
+        {
+            std::cout << "Trace: " << Trace::GetNumWritten() << " spans, " << Trace::GetNumOverwritten() << " overwritten, written to " << settings.tracePath << std::endl;
+        }
+        else
+        {
+            std::cerr << "Could not write trace to " << settings.tracePath << std::endl;
+        }
+    }
 
     return 0;
 }